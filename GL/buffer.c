@@ -0,0 +1,248 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "private.h"
+#include "config.h"
+
+static NamedArray BUFFER_OBJECTS;
+
+static GLuint ARRAY_BUFFER = 0;
+static GLuint ELEMENT_ARRAY_BUFFER = 0;
+
+void _glInitBuffers() {
+    named_array_init(&BUFFER_OBJECTS, sizeof(BufferObject), MAX_BUFFER_COUNT);
+
+    // Reserve zero so that it is never given to anyone as an ID!
+    named_array_reserve(&BUFFER_OBJECTS, 0);
+}
+
+BufferObject* _glGetBufferObject(GLuint buffer) {
+    if(!buffer || !named_array_used(&BUFFER_OBJECTS, buffer)) {
+        return NULL;
+    }
+
+    return (BufferObject*) named_array_get(&BUFFER_OBJECTS, buffer);
+}
+
+GLuint _glGetBoundArrayBuffer() {
+    return ARRAY_BUFFER;
+}
+
+GLuint _glGetBoundElementBuffer() {
+    return ELEMENT_ARRAY_BUFFER;
+}
+
+static GLuint* _glBufferBinding(GLenum target) {
+    switch(target) {
+        case GL_ARRAY_BUFFER_ARB:
+            return &ARRAY_BUFFER;
+        case GL_ELEMENT_ARRAY_BUFFER_ARB:
+            return &ELEMENT_ARRAY_BUFFER;
+        default:
+            return NULL;
+    }
+}
+
+/* Returns the buffer bound to target, raising an error if there isn't one */
+static BufferObject* _glBoundBuffer(GLenum target, const char* func) {
+    GLuint* binding = _glBufferBinding(target);
+
+    if(!binding) {
+        _glKosThrowError(GL_INVALID_ENUM, func);
+        _glKosPrintError();
+        return NULL;
+    }
+
+    BufferObject* buffer = _glGetBufferObject(*binding);
+    if(!buffer) {
+        _glKosThrowError(GL_INVALID_OPERATION, func);
+        _glKosPrintError();
+        return NULL;
+    }
+
+    return buffer;
+}
+
+static void _glInitBufferObject(BufferObject* buffer, GLuint id) {
+    memset(buffer, 0, sizeof(BufferObject));
+
+    buffer->index = id;
+    buffer->usage = GL_STATIC_DRAW_ARB;
+    aligned_vector_init(&buffer->vertices, sizeof(Vertex));
+    aligned_vector_init(&buffer->extras, sizeof(VertexExtra));
+}
+
+void APIENTRY glGenBuffersARB(GLsizei n, GLuint* buffers) {
+    TRACE();
+
+    while(n--) {
+        GLuint id = 0;
+        BufferObject* buffer = (BufferObject*) named_array_alloc(&BUFFER_OBJECTS, &id);
+
+        if(!buffer) {
+            _glKosThrowError(GL_OUT_OF_MEMORY, __func__);
+            _glKosPrintError();
+            return;
+        }
+
+        _glInitBufferObject(buffer, id);
+        *buffers++ = id;
+    }
+}
+
+void APIENTRY glDeleteBuffersARB(GLsizei n, const GLuint* buffers) {
+    TRACE();
+
+    while(n--) {
+        GLuint id = *buffers++;
+
+        BufferObject* buffer = _glGetBufferObject(id);
+        if(!buffer) {
+            /* Unused names are silently ignored */
+            continue;
+        }
+
+        if(ARRAY_BUFFER == id) {
+            ARRAY_BUFFER = 0;
+        }
+
+        if(ELEMENT_ARRAY_BUFFER == id) {
+            ELEMENT_ARRAY_BUFFER = 0;
+        }
+
+        _glUnbindBufferFromAttribs(id);
+
+        free(buffer->data);
+        _glFreeStripList(&buffer->strips);
+        aligned_vector_cleanup(&buffer->vertices);
+        aligned_vector_cleanup(&buffer->extras);
+
+        named_array_release(&BUFFER_OBJECTS, id);
+    }
+}
+
+void APIENTRY glBindBufferARB(GLenum target, GLuint buffer) {
+    TRACE();
+
+    GLuint* binding = _glBufferBinding(target);
+
+    if(!binding) {
+        _glKosThrowError(GL_INVALID_ENUM, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    if(buffer >= MAX_BUFFER_COUNT) {
+        _glKosThrowError(GL_INVALID_VALUE, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    if(buffer && !named_array_used(&BUFFER_OBJECTS, buffer)) {
+        /* Names which were never generated are created on first bind */
+        _glInitBufferObject((BufferObject*) named_array_reserve(&BUFFER_OBJECTS, buffer), buffer);
+    }
+
+    *binding = buffer;
+}
+
+void APIENTRY glBufferDataARB(GLenum target, GLsizeiptrARB size, const GLvoid* data, GLenum usage) {
+    TRACE();
+
+    GLint validUsages[] = {
+        GL_STREAM_DRAW_ARB,
+        GL_STREAM_READ_ARB,
+        GL_STREAM_COPY_ARB,
+        GL_STATIC_DRAW_ARB,
+        GL_STATIC_READ_ARB,
+        GL_STATIC_COPY_ARB,
+        GL_DYNAMIC_DRAW_ARB,
+        GL_DYNAMIC_READ_ARB,
+        GL_DYNAMIC_COPY_ARB,
+        0
+    };
+
+    if(_glCheckValidEnum(usage, validUsages, __func__) != 0) {
+        return;
+    }
+
+    if(size < 0) {
+        _glKosThrowError(GL_INVALID_VALUE, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    BufferObject* buffer = _glBoundBuffer(target, __func__);
+    if(!buffer) {
+        return;
+    }
+
+    GLubyte* storage = NULL;
+    if(size) {
+        storage = (GLubyte*) malloc(size);
+        if(!storage) {
+            _glKosThrowError(GL_OUT_OF_MEMORY, __func__);
+            _glKosPrintError();
+            return;
+        }
+
+        if(data) {
+            memcpy(storage, data, size);
+        }
+    }
+
+    free(buffer->data);
+    buffer->data = storage;
+    buffer->size = size;
+    buffer->usage = usage;
+    buffer->version++;
+
+    /* Drop any converted copy now rather than waiting for the next draw */
+    buffer->converted = GL_FALSE;
+    aligned_vector_clear(&buffer->vertices);
+    aligned_vector_clear(&buffer->extras);
+}
+
+void APIENTRY glBufferSubDataARB(GLenum target, GLintptrARB offset, GLsizeiptrARB size, const GLvoid* data) {
+    TRACE();
+
+    BufferObject* buffer = _glBoundBuffer(target, __func__);
+    if(!buffer) {
+        return;
+    }
+
+    if(offset < 0 || size < 0 || offset + size > buffer->size) {
+        _glKosThrowError(GL_INVALID_VALUE, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    memcpy(buffer->data + offset, data, size);
+    buffer->version++;
+}
+
+void APIENTRY glGetBufferParameterivARB(GLenum target, GLenum pname, GLint* params) {
+    TRACE();
+
+    BufferObject* buffer = _glBoundBuffer(target, __func__);
+    if(!buffer) {
+        return;
+    }
+
+    switch(pname) {
+        case GL_BUFFER_SIZE_ARB:
+            *params = (GLint) buffer->size;
+        break;
+        case GL_BUFFER_USAGE_ARB:
+            *params = (GLint) buffer->usage;
+        break;
+        default:
+            _glKosThrowError(GL_INVALID_ENUM, __func__);
+            _glKosPrintError();
+    }
+}
+
+GLboolean APIENTRY glIsBufferARB(GLuint buffer) {
+    return (_glGetBufferObject(buffer)) ? GL_TRUE : GL_FALSE;
+}
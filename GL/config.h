@@ -2,3 +2,13 @@
 
 /* This figure is derived from the needs of Quake 1 */
 #define MAX_TEXTURE_COUNT 1088
+
+/* Buffer object names, including the reserved zero */
+#define MAX_BUFFER_COUNT 256
+
+/* Entries in the post-transform vertex cache used by indexed draws,
+ * must be a power of two */
+#define VERTEX_CACHE_SIZE 256
+
+/* Display list names, including the reserved zero */
+#define MAX_DISPLAY_LIST_COUNT 1024
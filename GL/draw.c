@@ -5,6 +5,7 @@
 #include <math.h>
 #include <assert.h>
 
+#include "config.h"
 #include "private.h"
 #include "platform.h"
 
@@ -50,6 +51,41 @@ void _glInitAttributePointers() {
     NORMAL_POINTER.stride = 0;
     NORMAL_POINTER.type = GL_FLOAT;
     NORMAL_POINTER.size = 3;
+
+    VERTEX_POINTER.buffer = DIFFUSE_POINTER.buffer = UV_POINTER.buffer = 0;
+    ST_POINTER.buffer = NORMAL_POINTER.buffer = 0;
+}
+
+static AttribPointer* const ATTRIB_POINTERS[] = {
+    &VERTEX_POINTER, &DIFFUSE_POINTER, &UV_POINTER, &ST_POINTER, &NORMAL_POINTER
+};
+
+static const GLuint ATTRIB_FLAGS[] = {
+    VERTEX_ENABLED_FLAG, DIFFUSE_ENABLED_FLAG, UV_ENABLED_FLAG, ST_ENABLED_FLAG, NORMAL_ENABLED_FLAG
+};
+
+#define ATTRIB_COUNT (sizeof(ATTRIB_POINTERS) / sizeof(AttribPointer*))
+
+void _glUnbindBufferFromAttribs(GLuint buffer) {
+    for(GLuint i = 0; i < ATTRIB_COUNT; ++i) {
+        AttribPointer* attrib = ATTRIB_POINTERS[i];
+        if(attrib->buffer == buffer) {
+            attrib->buffer = 0;
+            attrib->ptr = attrib->offset = NULL;
+        }
+    }
+}
+
+/* Pointers into buffer objects are stored as offsets, as the data store
+ * can be replaced after the pointer is specified */
+static void _glResolveBufferPointers() {
+    for(GLuint i = 0; i < ATTRIB_COUNT; ++i) {
+        AttribPointer* attrib = ATTRIB_POINTERS[i];
+        if(attrib->buffer) {
+            BufferObject* buffer = _glGetBufferObject(attrib->buffer);
+            attrib->ptr = buffer->data + (size_t) attrib->offset;
+        }
+    }
 }
 
 GL_FORCE_INLINE GLboolean _glIsVertexDataFastPathCompatible() {
@@ -442,11 +478,6 @@ GL_FORCE_INLINE void transformNormalToEyeSpace(GLfloat* normal) {
     mat_trans_normal3(normal[0], normal[1], normal[2]);
 }
 
-GL_FORCE_INLINE PolyHeader *_glSubmissionTargetHeader(SubmissionTarget* target) {
-    assert(target->header_offset < target->output->vector.size);
-    return aligned_vector_at(&target->output->vector, target->header_offset);
-}
-
 GL_INLINE_DEBUG Vertex* _glSubmissionTargetStart(SubmissionTarget* target) {
     assert(target->start_offset < target->output->vector.size);
     return aligned_vector_at(&target->output->vector, target->start_offset);
@@ -485,18 +516,115 @@ GL_FORCE_INLINE void genTriangleStrip(Vertex* output, GLuint count) {
     output[count - 1].flags = GPU_CMD_VERTEX_EOL;
 }
 
-static void genTriangleFan(Vertex* output, GLuint count) {
-    assert(count <= 255);
+/* Fans are sent as strips of two triangles, (i, i + 1, 0, i + 2), with
+ * a single triangle at the end for an odd number of triangles. That's
+ * two vertices per triangle instead of three, which is the best a strip
+ * can do for a fan without degenerate triangles. */
+GL_FORCE_INLINE GLuint fanVertexCount(GLuint count) {
+    const GLuint triangles = count - 2;
+    return (triangles * 2) + (triangles & 1);
+}
 
-    Vertex* dst = output + (((count - 2) * 3) - 1);
-    Vertex* src = output + (count - 1);
+static void genTriangleFan(Vertex* output, VertexExtra* extras, GLuint count) {
+    const GLuint triangles = count - 2;
 
-    GLubyte i = count - 2;
-    while(i--) {
-        *dst = *src--;
-        (*dst--).flags = GPU_CMD_VERTEX_EOL;
-        *dst-- = *src;
-        *dst-- = *output;
+    const Vertex centre = output[0];
+    const VertexExtra centreExtra = extras[0];
+
+    /* Written back to front, each batch only reads vertices which are
+     * below the ones it writes */
+    GLuint batch = (triangles + 1) / 2;
+    while(batch--) {
+        const GLuint i = (batch * 2) + 1;
+        const GLboolean single = (i + 2 == count);
+
+        Vertex* dst = output + (batch * 4);
+        VertexExtra* edst = extras + (batch * 4);
+
+        const Vertex v1 = output[i];
+        const Vertex v2 = output[i + 1];
+        const VertexExtra e1 = extras[i];
+        const VertexExtra e2 = extras[i + 1];
+
+        if(!single) {
+            dst[3] = output[i + 2];
+            edst[3] = extras[i + 2];
+            dst[3].flags = GPU_CMD_VERTEX_EOL;
+        }
+
+        dst[0] = v1;
+        dst[1] = v2;
+        dst[2] = centre;
+        edst[0] = e1;
+        edst[1] = e2;
+        edst[2] = centreExtra;
+
+        dst[0].flags = dst[1].flags = GPU_CMD_VERTEX;
+        dst[2].flags = (single) ? GPU_CMD_VERTEX_EOL : GPU_CMD_VERTEX;
+    }
+}
+
+/* Copies vertices aside for generators which reorder them in place */
+static void copyToScratch(const Vertex* output, const VertexExtra* extras, GLuint count,
+        const Vertex** src, const VertexExtra** esrc) {
+    static AlignedVector vertices;
+    static AlignedVector vertexExtras;
+
+    if(!vertices.element_size) {
+        aligned_vector_init(&vertices, sizeof(Vertex));
+        aligned_vector_init(&vertexExtras, sizeof(VertexExtra));
+    }
+
+    aligned_vector_resize(&vertices, 0);
+    aligned_vector_resize(&vertexExtras, 0);
+
+    *src = (const Vertex*) aligned_vector_push_back(&vertices, output, count);
+    *esrc = (const VertexExtra*) aligned_vector_push_back(&vertexExtras, extras, count);
+}
+
+/* Convex polygons are sent as a single strip zig-zagging between both
+ * sides, (0, 1, n - 1, 2, n - 2, ...), so need no extra vertices */
+static void genPolygon(Vertex* output, VertexExtra* extras, GLuint count) {
+    const Vertex* src;
+    const VertexExtra* esrc;
+    copyToScratch(output, extras, count, &src, &esrc);
+
+    GLuint left = 1;
+    GLuint right = count - 1;
+
+    for(GLuint i = 1; i < count; ++i) {
+        const GLuint j = (i & 1) ? left++ : right--;
+        output[i] = src[j];
+        extras[i] = esrc[j];
+    }
+
+    output[count - 1].flags = GPU_CMD_VERTEX_EOL;
+}
+
+/* When flat shading, the last vertex of each strip triangle provokes its
+ * colour, so fans and polygons copy the colour of the vertex which
+ * provoked each triangle before they were turned into strips onto it.
+ * This is kept apart from generating them so display lists can record
+ * fans and polygons whatever the shade model. */
+static void flatShadeStrips(Vertex* output, GLuint count, GLenum mode) {
+    if(mode == GL_TRIANGLE_FAN) {
+        /* The centre ends the first triangle of each (i, i + 1, 0, i + 2)
+         * strip, so carries the colour of the vertex ending it in the fan */
+        for(GLuint i = 0; i + 2 < count; i += 4) {
+            argbcpy(output[i + 2].bgra, output[i + 1].bgra);
+        }
+    } else if(mode == GL_POLYGON) {
+        /* The first vertex is the provoking one for polygons */
+        for(GLuint i = 1; i < count; ++i) {
+            argbcpy(output[i].bgra, output[0].bgra);
+        }
+    }
+}
+
+/* Ends each strip of a stripified draw, the vertices are already in order */
+GL_FORCE_INLINE void genStrips(Vertex* output, const StripList* strips) {
+    for(GLuint i = 0; i < strips->strip_count; ++i) {
+        output[strips->ends[i]].flags = GPU_CMD_VERTEX_EOL;
     }
 }
 
@@ -683,6 +811,17 @@ static void _readSTData(ReadUVFunc func, const GLuint first, const GLuint count,
     }
 }
 
+GL_FORCE_INLINE void normalizeNormal(GLfloat* n) {
+    float temp = n[0] * n[0];
+    temp = MATH_fmac(n[1], n[1], temp);
+    temp = MATH_fmac(n[2], n[2], temp);
+
+    float ilength = MATH_fsrra(temp);
+    n[0] *= ilength;
+    n[1] *= ilength;
+    n[2] *= ilength;
+}
+
 static void _readNormalData(ReadNormalFunc func, const GLuint first, const GLuint count, const VertexExtra* extra) {
     const GLsizei nstride = NORMAL_POINTER.stride;
     const GLubyte* nptr = ((GLubyte*) NORMAL_POINTER.ptr + (first * nstride));
@@ -698,16 +837,7 @@ static void _readNormalData(ReadNormalFunc func, const GLuint first, const GLuin
     if(_glIsNormalizeEnabled()) {
         GLubyte* ptr = (GLubyte*) extra->nxyz;
         ITERATE(count) {
-            GLfloat* n = (GLfloat*) ptr;
-            float temp = n[0] * n[0];
-            temp = MATH_fmac(n[1], n[1], temp);
-            temp = MATH_fmac(n[2], n[2], temp);
-
-            float ilength = MATH_fsrra(temp);
-            n[0] *= ilength;
-            n[1] *= ilength;
-            n[2] *= ilength;
-
+            normalizeNormal((GLfloat*) ptr);
             ptr += sizeof(VertexExtra);
         }
     }
@@ -732,6 +862,64 @@ static void _readDiffuseData(ReadDiffuseFunc func, const GLuint first, const GLu
     }
 }
 
+/* Indexed draws transform each vertex once and copy the result for any
+ * repeated index. The cache is direct-mapped on the index and is
+ * invalidated at the start of every draw (by bumping the epoch) as the
+ * matrices and arrays may have changed in between. */
+typedef struct {
+    Vertex vertex;
+    VertexExtra extra;
+    GLuint index;
+    GLuint epoch;
+} VertexCacheEntry;
+
+static VertexCacheEntry VERTEX_CACHE[VERTEX_CACHE_SIZE];
+static GLuint VERTEX_CACHE_EPOCH = 0;
+
+static VertexCacheStats VERTEX_CACHE_STATS = {0, 0};
+static VertexCacheStats VERTEX_CACHE_LAST_FRAME = {0, 0};
+
+const VertexCacheStats* _glGetVertexCacheStats() {
+    return &VERTEX_CACHE_LAST_FRAME;
+}
+
+void _glVertexCacheFrameEnd() {
+    VERTEX_CACHE_LAST_FRAME = VERTEX_CACHE_STATS;
+    VERTEX_CACHE_STATS.hits = VERTEX_CACHE_STATS.misses = 0;
+}
+
+static void _glVertexCacheInvalidate() {
+    if(!++VERTEX_CACHE_EPOCH) {
+        /* Wrapped, clear out entries which could now match */
+        memset(VERTEX_CACHE, 0, sizeof(VERTEX_CACHE));
+        VERTEX_CACHE_EPOCH = 1;
+    }
+}
+
+/* Copies the cached vertex for idx into it/ve, returns GL_FALSE on a miss */
+GL_FORCE_INLINE GLboolean _glVertexCacheFetch(const GLuint idx, Vertex* it, VertexExtra* ve) {
+    const VertexCacheEntry* entry = &VERTEX_CACHE[idx & (VERTEX_CACHE_SIZE - 1)];
+
+    if(entry->epoch == VERTEX_CACHE_EPOCH && entry->index == idx) {
+        *it = entry->vertex;
+        *ve = entry->extra;
+        ++VERTEX_CACHE_STATS.hits;
+        return GL_TRUE;
+    }
+
+    ++VERTEX_CACHE_STATS.misses;
+    return GL_FALSE;
+}
+
+GL_FORCE_INLINE void _glVertexCacheStore(const GLuint idx, const Vertex* it, const VertexExtra* ve) {
+    VertexCacheEntry* entry = &VERTEX_CACHE[idx & (VERTEX_CACHE_SIZE - 1)];
+
+    entry->vertex = *it;
+    entry->extra = *ve;
+    entry->index = idx;
+    entry->epoch = VERTEX_CACHE_EPOCH;
+}
+
 static void generateElements(
         SubmissionTarget* target, const GLsizei first, const GLuint count,
         const GLubyte* indices, const GLenum type) {
@@ -764,9 +952,15 @@ static void generateElements(
     const GLuint dstride = DIFFUSE_POINTER.stride;
     const GLuint nstride = NORMAL_POINTER.stride;
 
-    for(; i < first + count; ++i) {
+    const float w = 1.0f;
+
+    for(; i < first + count; ++i, ++output, ++ve) {
         idx = IndexFunc(indices + (i * istride));
 
+        if(_glVertexCacheFetch(idx, output, ve)) {
+            continue;
+        }
+
         xyz = (GLubyte*) VERTEX_POINTER.ptr + (idx * vstride);
         uv = (GLubyte*) UV_POINTER.ptr + (idx * uvstride);
         bgra = (GLubyte*) DIFFUSE_POINTER.ptr + (idx * dstride);
@@ -780,8 +974,9 @@ static void generateElements(
         normal_func(nxyz, (GLubyte*) ve->nxyz);
 
         output->flags = GPU_CMD_VERTEX;
-        ++output;
-        ++ve;
+        TransformVertex(output->xyz, &w, output->xyz, &output->w);
+
+        _glVertexCacheStore(idx, output, ve);
     }
 }
 
@@ -797,11 +992,46 @@ static const Float3 F3Z = {0.0f, 0.0f, 1.0f};
 static const Float3 F3ZERO = {0.0f, 0.0f, 0.0f};
 static const Float2 F2ZERO = {0.0f, 0.0f};
 
-static void generateElementsFastPath(
+/* The fast path kernels are specialised on the enabled attributes. mask
+ * is a constant in each instantiation below, so the per-attribute tests
+ * fold away and leave a branch-free copy loop. */
+#define FAST_PATH_ATTRIBUTES (UV_ENABLED_FLAG | ST_ENABLED_FLAG | DIFFUSE_ENABLED_FLAG | NORMAL_ENABLED_FLAG)
+
+GL_FORCE_INLINE void fastPathCopyAttributes(
+        Vertex* it, VertexExtra* ve, const GLubyte* uv, const GLubyte* col,
+        const GLubyte* st, const GLubyte* n, const GLuint mask) {
+
+    if(mask & UV_ENABLED_FLAG) {
+        MEMCPY4(it->uv, uv, sizeof(float) * 2);
+    } else {
+        *((Float2*) it->uv) = F2ZERO;
+    }
+
+    if(mask & DIFFUSE_ENABLED_FLAG) {
+        MEMCPY4(it->bgra, col, sizeof(uint32_t));
+    } else {
+        *((uint32_t*) it->bgra) = ~0;
+    }
+
+    if(mask & ST_ENABLED_FLAG) {
+        MEMCPY4(ve->st, st, sizeof(float) * 2);
+    } else {
+        *((Float2*) ve->st) = F2ZERO;
+    }
+
+    if(mask & NORMAL_ENABLED_FLAG) {
+        MEMCPY4(ve->nxyz, n, sizeof(float) * 3);
+    } else {
+        *((Float3*) ve->nxyz) = F3Z;
+    }
+}
+
+GL_FORCE_INLINE void generateElementsFastPathKernel(
         SubmissionTarget* target, const GLsizei first, const GLuint count,
-        const GLubyte* indices, const GLenum type) {
+        const GLubyte* indices, const GLenum type, const GLuint mask) {
 
-    Vertex* start = _glSubmissionTargetStart(target);
+    Vertex* it = _glSubmissionTargetStart(target);
+    VertexExtra* ve = aligned_vector_at(target->extras, 0);
 
     const GLuint vstride = VERTEX_POINTER.stride;
     const GLuint uvstride = UV_POINTER.stride;
@@ -812,67 +1042,40 @@ static void generateElementsFastPath(
     const GLsizei istride = byte_size(type);
     const IndexParseFunc IndexFunc = _calcParseIndexFunc(type);
 
-    /* Copy the pos, uv and color directly in one go */
-    const GLubyte* pos = (ENABLED_VERTEX_ATTRIBUTES & VERTEX_ENABLED_FLAG) ? VERTEX_POINTER.ptr : NULL;
-    const GLubyte* uv = (ENABLED_VERTEX_ATTRIBUTES & UV_ENABLED_FLAG) ? UV_POINTER.ptr : NULL;
-    const GLubyte* col = (ENABLED_VERTEX_ATTRIBUTES & DIFFUSE_ENABLED_FLAG) ? DIFFUSE_POINTER.ptr : NULL;
-    const GLubyte* st = (ENABLED_VERTEX_ATTRIBUTES & ST_ENABLED_FLAG) ? ST_POINTER.ptr : NULL;
-    const GLubyte* n = (ENABLED_VERTEX_ATTRIBUTES & NORMAL_ENABLED_FLAG) ? NORMAL_POINTER.ptr : NULL;
-
-    VertexExtra* ve = aligned_vector_at(target->extras, 0);
-    Vertex* it = start;
-
     const float w = 1.0f;
 
-    if(!pos) {
-        return;
-    }
-
-    for(GLuint i = first; i < first + count; ++i) {
+    /* Unlike the arrays kernel this transforms per vertex, so that only
+     * cache misses are transformed and hits copy the result */
+    for(GLuint i = first; i < first + count; ++i, ++it, ++ve) {
         GLuint idx = IndexFunc(indices + (i * istride));
 
-        it->flags = GPU_CMD_VERTEX;
-
-        pos = (GLubyte*) VERTEX_POINTER.ptr + (idx * vstride);
-        TransformVertex((const float*) pos, &w, it->xyz, &it->w);
-
-        if(uv) {
-            uv = (GLubyte*) UV_POINTER.ptr + (idx * uvstride);
-            MEMCPY4(it->uv, uv, sizeof(float) * 2);
-        } else {
-            *((Float2*) it->uv) = F2ZERO;
+        if(_glVertexCacheFetch(idx, it, ve)) {
+            continue;
         }
 
-        if(col) {
-            col = (GLubyte*) DIFFUSE_POINTER.ptr + (idx * dstride);
-            MEMCPY4(it->bgra, col, sizeof(uint32_t));
-        } else {
-            *((uint32_t*) it->bgra) = ~0;
-        }
+        it->flags = GPU_CMD_VERTEX;
 
-        if(st) {
-            st = (GLubyte*) ST_POINTER.ptr + (idx * ststride);
-            MEMCPY4(ve->st, st, sizeof(float) * 2);
-        } else {
-            *((Float2*) ve->st) = F2ZERO;
-        }
+        const GLubyte* pos = (GLubyte*) VERTEX_POINTER.ptr + (idx * vstride);
+        TransformVertex((const float*) pos, &w, it->xyz, &it->w);
 
-        if(n) {
-            n = (GLubyte*) NORMAL_POINTER.ptr + (idx * nstride);
-            MEMCPY4(ve->nxyz, n, sizeof(float) * 3);
-        } else {
-            *((Float3*) ve->nxyz) = F3Z;
-        }
+        fastPathCopyAttributes(
+            it, ve,
+            (GLubyte*) UV_POINTER.ptr + (idx * uvstride),
+            (GLubyte*) DIFFUSE_POINTER.ptr + (idx * dstride),
+            (GLubyte*) ST_POINTER.ptr + (idx * ststride),
+            (GLubyte*) NORMAL_POINTER.ptr + (idx * nstride),
+            mask
+        );
 
-        it++;
-        ve++;
+        _glVertexCacheStore(idx, it, ve);
     }
 }
 
-#define likely(x)      __builtin_expect(!!(x), 1)
+GL_FORCE_INLINE void generateArraysFastPathKernel(
+        SubmissionTarget* target, const GLsizei first, const GLuint count, const GLuint mask) {
 
-static void generateArraysFastPath(SubmissionTarget* target, const GLsizei first, const GLuint count) {
-    Vertex* start = _glSubmissionTargetStart(target);
+    Vertex* it = _glSubmissionTargetStart(target);
+    VertexExtra* ve = aligned_vector_at(target->extras, 0);
 
     const GLuint vstride = VERTEX_POINTER.stride;
     const GLuint uvstride = UV_POINTER.stride;
@@ -881,193 +1084,541 @@ static void generateArraysFastPath(SubmissionTarget* target, const GLsizei first
     const GLuint nstride = NORMAL_POINTER.stride;
 
     /* Copy the pos, uv and color directly in one go */
-    const GLubyte* pos = (ENABLED_VERTEX_ATTRIBUTES & VERTEX_ENABLED_FLAG) ? VERTEX_POINTER.ptr + (first * vstride) : NULL;
-    const GLubyte* uv = (ENABLED_VERTEX_ATTRIBUTES & UV_ENABLED_FLAG) ? UV_POINTER.ptr + (first * uvstride) : NULL;
-    const GLubyte* col = (ENABLED_VERTEX_ATTRIBUTES & DIFFUSE_ENABLED_FLAG) ? DIFFUSE_POINTER.ptr + (first * dstride) : NULL;
-    const GLubyte* st = (ENABLED_VERTEX_ATTRIBUTES & ST_ENABLED_FLAG) ? ST_POINTER.ptr + (first * ststride) : NULL;
-    const GLubyte* n = (ENABLED_VERTEX_ATTRIBUTES & NORMAL_ENABLED_FLAG) ? NORMAL_POINTER.ptr + (first * nstride) : NULL;
+    const GLubyte* pos = VERTEX_POINTER.ptr + (first * vstride);
+    const GLubyte* uv = UV_POINTER.ptr + (first * uvstride);
+    const GLubyte* col = DIFFUSE_POINTER.ptr + (first * dstride);
+    const GLubyte* st = ST_POINTER.ptr + (first * ststride);
+    const GLubyte* n = NORMAL_POINTER.ptr + (first * nstride);
 
-    VertexExtra* ve = aligned_vector_at(target->extras, 0);
-    Vertex* it = start;
+    ITERATE(count) {
+        it->flags = GPU_CMD_VERTEX;
 
-    const float w = 1.0f;
+        MEMCPY4(it->xyz, pos, sizeof(float) * 3);
+        fastPathCopyAttributes(it, ve, uv, col, st, n, mask);
 
-    uint32_t i = count;
+        pos += vstride;
+        uv += uvstride;
+        col += dstride;
+        st += ststride;
+        n += nstride;
 
-    if(!pos) {
-        /* If we don't have vertices, do nothing */
-        return;
+        it++;
+        ve++;
     }
 
-    while(i--) {
-        it->flags = GPU_CMD_VERTEX;
-
-        TransformVertex((const float*) pos, &w, it->xyz, &it->w);
-        pos += vstride;
+    /* Transform the whole draw in one batch */
+    TransformVertices(_glSubmissionTargetStart(target), count);
+}
 
-        if(uv) {
-            MEMCPY4(it->uv, uv, sizeof(float) * 2);
-            uv += uvstride;
-        } else {
-            *((Float2*) it->uv) = F2ZERO;
-        }
+/* Every combination of the fast path attributes, in order of mask */
+#define FAST_PATH_MASKS(X) \
+    X(0)  X(2)  X(4)  X(6)  X(8)  X(10) X(12) X(14) \
+    X(16) X(18) X(20) X(22) X(24) X(26) X(28) X(30)
 
-        if(col) {
-            MEMCPY4(it->bgra, col, sizeof(uint32_t));
-            col += dstride;
-        } else {
-            *((uint32_t*) it->bgra) = ~0;
-        }
+typedef void (*ElementsFastPathFunc)(SubmissionTarget*, const GLsizei, const GLuint, const GLubyte*, const GLenum);
+typedef void (*ArraysFastPathFunc)(SubmissionTarget*, const GLsizei, const GLuint);
 
-        if(st) {
-            MEMCPY4(ve->st, st, sizeof(float) * 2);
-            st += ststride;
-        } else {
-            *((Float2*) ve->st) = F2ZERO;
-        }
+#define DEFINE_FAST_PATH(mask) \
+    static void generateElementsFastPath##mask( \
+            SubmissionTarget* target, const GLsizei first, const GLuint count, \
+            const GLubyte* indices, const GLenum type) { \
+        generateElementsFastPathKernel(target, first, count, indices, type, mask); \
+    } \
+    static void generateArraysFastPath##mask(SubmissionTarget* target, const GLsizei first, const GLuint count) { \
+        generateArraysFastPathKernel(target, first, count, mask); \
+    }
 
-        if(n) {
-            MEMCPY4(ve->nxyz, n, sizeof(float) * 3);
-            n += nstride;
-        } else {
-            *((Float3*) ve->nxyz) = F3Z;
-        }
+FAST_PATH_MASKS(DEFINE_FAST_PATH)
 
-        it++;
-        ve++;
-    }
-}
+#define ELEMENTS_FAST_PATH_ENTRY(mask) generateElementsFastPath##mask,
+#define ARRAYS_FAST_PATH_ENTRY(mask) generateArraysFastPath##mask,
 
-static void generateArrays(SubmissionTarget* target, const GLsizei first, const GLuint count) {
-    Vertex* start = _glSubmissionTargetStart(target);
-    VertexExtra* ve = aligned_vector_at(target->extras, 0);
+static const ElementsFastPathFunc ELEMENTS_FAST_PATHS[] = {
+    FAST_PATH_MASKS(ELEMENTS_FAST_PATH_ENTRY)
+};
 
-    ReadPositionFunc pfunc = calcReadPositionFunc();
-    ReadDiffuseFunc dfunc = calcReadDiffuseFunc();
-    ReadUVFunc uvfunc = calcReadUVFunc();
-    ReadNormalFunc nfunc = calcReadNormalFunc();
-    ReadUVFunc stfunc = calcReadSTFunc();
+static const ArraysFastPathFunc ARRAYS_FAST_PATHS[] = {
+    FAST_PATH_MASKS(ARRAYS_FAST_PATH_ENTRY)
+};
 
-    _readPositionData(pfunc, first, count, start);
-    _readDiffuseData(dfunc, first, count, start);
-    _readUVData(uvfunc, first, count, start);
-    _readNormalData(nfunc, first, count, ve);
-    _readSTData(stfunc, first, count, ve);
+/* The attribute flags are bits 1-4, so shifting down gives the table index */
+GL_FORCE_INLINE GLuint fastPathIndex() {
+    return (ENABLED_VERTEX_ATTRIBUTES & FAST_PATH_ATTRIBUTES) >> 1;
 }
 
-static void generate(SubmissionTarget* target, const GLenum mode, const GLsizei first, const GLuint count,
+static void generateElementsFastPath(
+        SubmissionTarget* target, const GLsizei first, const GLuint count,
         const GLubyte* indices, const GLenum type) {
-    /* Read from the client buffers and generate an array of ClipVertices */
-    TRACE();
-
-    if(FAST_PATH_ENABLED) {
-        if(indices) {
-            generateElementsFastPath(target, first, count, indices, type);
-        } else {
-            generateArraysFastPath(target, first, count);
-        }
-    } else {
-        if(indices) {
-            generateElements(target, first, count, indices, type);
-        } else {
-            generateArrays(target, first, count);
-        }
-    }
 
-    Vertex* it = _glSubmissionTargetStart(target);
-    // Drawing arrays
-    switch(mode) {
-    case GL_TRIANGLES:
-        genTriangles(it, count);
-        break;
-    case GL_QUADS:
-        genQuads(it, count);
-        break;
-    case GL_TRIANGLE_FAN:
-        genTriangleFan(it, count);
-        break;
-    case GL_TRIANGLE_STRIP:
-        genTriangleStrip(it, count);
-        break;
-    default:
-        assert(0 && "Not Implemented");
-    }
+    ELEMENTS_FAST_PATHS[fastPathIndex()](target, first, count, indices, type);
 }
 
-static void transform(SubmissionTarget* target) {
-    TRACE();
-
-    /* Perform modelview transform, storing W */
-    Vertex* vertex = _glSubmissionTargetStart(target);
-
-    TransformVertices(vertex, target->count);
+static void generateArraysFastPath(SubmissionTarget* target, const GLsizei first, const GLuint count) {
+    ARRAYS_FAST_PATHS[fastPathIndex()](target, first, count);
 }
 
-static void clip(SubmissionTarget* target) {
-    TRACE();
+/* Reads, converts and transforms each vertex in one go while the
+ * source data is still in cache, writing each Vertex once */
+static void generateArrays(SubmissionTarget* target, const GLsizei first, const GLuint count) {
+    Vertex* it = _glSubmissionTargetStart(target);
+    VertexExtra* ve = aligned_vector_at(target->extras, 0);
 
-    /* Perform clipping, generating new vertices as necessary */
-    _glClipTriangleStrip(target, _glGetShadeModel() == GL_FLAT);
+    const ReadPositionFunc pos_func = calcReadPositionFunc();
+    const ReadUVFunc uv_func = calcReadUVFunc();
+    const ReadUVFunc st_func = calcReadSTFunc();
+    const ReadDiffuseFunc diffuse_func = calcReadDiffuseFunc();
+    const ReadNormalFunc normal_func = calcReadNormalFunc();
 
-    /* Reset the count now that we may have added vertices */
-    target->count = target->output->vector.size - target->start_offset;
-}
+    const GLsizei vstride = VERTEX_POINTER.stride;
+    const GLuint uvstride = UV_POINTER.stride;
+    const GLuint ststride = ST_POINTER.stride;
+    const GLuint dstride = DIFFUSE_POINTER.stride;
+    const GLuint nstride = NORMAL_POINTER.stride;
 
-static void mat_transform3(const float* xyz, const float* xyzOut, const uint32_t count, const uint32_t inStride, const uint32_t outStride) {
-    const uint8_t* dataIn = (const uint8_t*) xyz;
-    uint8_t* dataOut = (uint8_t*) xyzOut;
+    const GLubyte* xyz = (GLubyte*) VERTEX_POINTER.ptr + (first * vstride);
+    const GLubyte* uv = (GLubyte*) UV_POINTER.ptr + (first * uvstride);
+    const GLubyte* bgra = (GLubyte*) DIFFUSE_POINTER.ptr + (first * dstride);
+    const GLubyte* st = (GLubyte*) ST_POINTER.ptr + (first * ststride);
+    const GLubyte* nxyz = (GLubyte*) NORMAL_POINTER.ptr + (first * nstride);
+
+    const GLboolean normalize = _glIsNormalizeEnabled();
+    const float w = 1.0f;
 
     ITERATE(count) {
-        const float* in = (const float*) dataIn;
-        float* out = (float*) dataOut;
+        PREFETCH(xyz + vstride);
 
-        TransformVec3NoMod(
-            in,
-            out
-        );
+        pos_func(xyz, (GLubyte*) it->xyz);
+        TransformVertex(it->xyz, &w, it->xyz, &it->w);
 
-        dataIn += inStride;
-        dataOut += outStride;
-    }
-}
+        uv_func(uv, (GLubyte*) it->uv);
+        diffuse_func(bgra, it->bgra);
+        st_func(st, (GLubyte*) ve->st);
+        normal_func(nxyz, (GLubyte*) ve->nxyz);
 
-static void mat_transform_normal3(const float* xyz, const float* xyzOut, const uint32_t count, const uint32_t inStride, const uint32_t outStride) {
-    const uint8_t* dataIn = (const uint8_t*) xyz;
-    uint8_t* dataOut = (uint8_t*) xyzOut;
+        if(normalize) {
+            normalizeNormal(ve->nxyz);
+        }
 
-    ITERATE(count) {
-        const float* in = (const float*) dataIn;
-        float* out = (float*) dataOut;
+        it->flags = GPU_CMD_VERTEX;
 
-        TransformNormalNoMod(in, out);
+        xyz += vstride;
+        uv += uvstride;
+        bgra += dstride;
+        st += ststride;
+        nxyz += nstride;
 
-        dataIn += inStride;
-        dataOut += outStride;
+        ++it;
+        ++ve;
     }
 }
 
-static void light(SubmissionTarget* target) {
+GL_FORCE_INLINE GLsizei attribElementSize(const AttribPointer* attrib) {
+    return ((attrib->size == GL_BGRA) ? 4 : attrib->size) * byte_size(attrib->type);
+}
 
-    static AlignedVector* eye_space_data = NULL;
+/* If every enabled array comes from the same static buffer, returns that
+ * buffer with its contents converted to Vertex/VertexExtra for the current
+ * layout. The conversion only happens when the data or layout changed. */
+static const BufferObject* _glConvertedBuffer() {
+    if(!VERTEX_POINTER.buffer) {
+        return NULL;
+    }
 
-    if(!eye_space_data) {
-        eye_space_data = (AlignedVector*) malloc(sizeof(AlignedVector));
-        aligned_vector_init(eye_space_data, sizeof(EyeSpaceData));
+    BufferObject* buffer = _glGetBufferObject(VERTEX_POINTER.buffer);
+    if(buffer->usage != GL_STATIC_DRAW_ARB) {
+        return NULL;
     }
 
-    aligned_vector_resize(eye_space_data, target->count);
+    VertexLayout layout;
+    memset(&layout, 0, sizeof(VertexLayout));
+    layout.enabled = ENABLED_VERTEX_ATTRIBUTES;
+    layout.normalize = _glIsNormalizeEnabled();
 
-    /* Perform lighting calculations and manipulate the colour */
-    Vertex* vertex = _glSubmissionTargetStart(target);
-    VertexExtra* extra = aligned_vector_at(target->extras, 0);
-    EyeSpaceData* eye_space = (EyeSpaceData*) eye_space_data->data;
+    /* The number of vertices with every attribute inside the buffer */
+    GLsizeiptrARB count = buffer->size;
 
-    _glMatrixLoadNormal();
-    mat_transform_normal3(extra->nxyz, eye_space->n, target->count, sizeof(VertexExtra), sizeof(EyeSpaceData));
+    for(GLuint i = 0; i < ATTRIB_COUNT; ++i) {
+        if(!(ENABLED_VERTEX_ATTRIBUTES & ATTRIB_FLAGS[i])) {
+            continue;
+        }
 
-    EyeSpaceData* ES = aligned_vector_at(eye_space_data, 0);
-    _glPerformLighting(vertex, ES, target->count);
-}
+        const AttribPointer* attrib = ATTRIB_POINTERS[i];
+        if(attrib->buffer != VERTEX_POINTER.buffer || attrib->stride <= 0) {
+            return NULL;
+        }
+
+        layout.attribs[i] = *attrib;
+
+        const GLsizeiptrARB end = (size_t) attrib->offset + attribElementSize(attrib);
+        count = MIN(count, (end > buffer->size) ? 0 : ((buffer->size - end) / attrib->stride) + 1);
+    }
+
+    if(buffer->converted && buffer->converted_version == buffer->version &&
+        memcmp(&layout, &buffer->converted_layout, sizeof(VertexLayout)) == 0) {
+        return buffer;
+    }
+
+    aligned_vector_resize(&buffer->vertices, count);
+    aligned_vector_resize(&buffer->extras, count);
+
+    Vertex* vertices = (Vertex*) buffer->vertices.data;
+    VertexExtra* extras = (VertexExtra*) buffer->extras.data;
+
+    if(count) {
+        _readPositionData(calcReadPositionFunc(), 0, count, vertices);
+        _readDiffuseData(calcReadDiffuseFunc(), 0, count, vertices);
+        _readUVData(calcReadUVFunc(), 0, count, vertices);
+        _readNormalData(calcReadNormalFunc(), 0, count, extras);
+        _readSTData(calcReadSTFunc(), 0, count, extras);
+    }
+
+    buffer->converted = GL_TRUE;
+    buffer->converted_serial++;
+    buffer->converted_version = buffer->version;
+    buffer->converted_count = count;
+    buffer->converted_layout = layout;
+
+    return buffer;
+}
+
+GL_FORCE_INLINE void copyConvertedVertex(Vertex* it, VertexExtra* ve, const Vertex* src, const VertexExtra* src_ve) {
+    const float w = 1.0f;
+
+    it->flags = GPU_CMD_VERTEX;
+    TransformVertex(src->xyz, &w, it->xyz, &it->w);
+    vec2cpy(it->uv, src->uv);
+    argbcpy(it->bgra, src->bgra);
+    *ve = *src_ve;
+}
+
+static void generateArraysFromBuffer(SubmissionTarget* target, const BufferObject* buffer, const GLsizei first, const GLuint count) {
+    Vertex* it = _glSubmissionTargetStart(target);
+    VertexExtra* ve = aligned_vector_at(target->extras, 0);
+
+    const Vertex* src = (const Vertex*) aligned_vector_at(&buffer->vertices, first);
+    const VertexExtra* src_ve = (const VertexExtra*) aligned_vector_at(&buffer->extras, first);
+
+    /* The converted vertices only need transforming, which is done as
+     * one batch over the copy */
+    FASTCPY(it, src, sizeof(Vertex) * count);
+    memcpy(ve, src_ve, sizeof(VertexExtra) * count);
+
+    TransformVertices(it, count);
+}
+
+static void generateElementsFromBuffer(
+        SubmissionTarget* target, const BufferObject* buffer, const GLsizei first, const GLuint count,
+        const GLubyte* indices, const GLenum type) {
+
+    const GLsizei istride = byte_size(type);
+    const IndexParseFunc IndexFunc = _calcParseIndexFunc(type);
+
+    Vertex* it = _glSubmissionTargetStart(target);
+    VertexExtra* ve = aligned_vector_at(target->extras, 0);
+
+    const Vertex* src = (const Vertex*) buffer->vertices.data;
+    const VertexExtra* src_ve = (const VertexExtra*) buffer->extras.data;
+
+    for(GLuint i = first; i < first + count; ++i, ++it, ++ve) {
+        const GLuint idx = IndexFunc(indices + (i * istride));
+
+        if(_glVertexCacheFetch(idx, it, ve)) {
+            continue;
+        }
+
+        copyConvertedVertex(it, ve, src + idx, src_ve + idx);
+        _glVertexCacheStore(idx, it, ve);
+    }
+}
+
+/* Returns the strips for a GL_TRIANGLES draw from buffer objects, joining
+ * the triangles only when the range or its data changed since the last
+ * draw. Indexed draws need an element buffer, other draws a converted
+ * static vertex buffer whose identical vertices are welded together. */
+static const StripList* _glBufferStrips(const BufferObject* converted, const GLsizei first, const GLuint count,
+        const GLubyte* indices, GLenum type) {
+    BufferObject* buffer;
+    GLuint version;
+    GLsizeiptrARB start;
+
+    if(indices) {
+        buffer = _glGetBufferObject(_glGetBoundElementBuffer());
+        if(!buffer) {
+            return NULL;
+        }
+
+        version = buffer->version;
+        start = indices - buffer->data;
+    } else {
+        buffer = (BufferObject*) converted;
+        if(!buffer) {
+            return NULL;
+        }
+
+        version = buffer->converted_serial;
+        start = first;
+        type = 0;
+    }
+
+    if(buffer->strips_valid && buffer->strips_version == version && buffer->strips_type == type &&
+        buffer->strips_first == start && buffer->strips_count == count) {
+        return &buffer->strips;
+    }
+
+    GLuint* triangles = (GLuint*) malloc(sizeof(GLuint) * count);
+    if(!triangles) {
+        return NULL;
+    }
+
+    GLboolean ok = GL_TRUE;
+
+    if(indices) {
+        const GLsizei istride = byte_size(type);
+        const IndexParseFunc IndexFunc = _calcParseIndexFunc(type);
+
+        for(GLuint i = 0; i < count; ++i) {
+            triangles[i] = IndexFunc(indices + (i * istride));
+        }
+    } else {
+        ok = _glWeldVertices(
+            aligned_vector_at(&buffer->vertices, first),
+            aligned_vector_at(&buffer->extras, first),
+            count, triangles
+        );
+
+        for(GLuint i = 0; i < count; ++i) {
+            triangles[i] += first;
+        }
+    }
+
+    _glFreeStripList(&buffer->strips);
+    buffer->strips_valid = ok && _glStripify(triangles, count, &buffer->strips);
+    buffer->strips_version = version;
+    buffer->strips_type = type;
+    buffer->strips_first = start;
+    buffer->strips_count = count;
+
+    free(triangles);
+
+    return (buffer->strips_valid) ? &buffer->strips : NULL;
+}
+
+/* Joins the generated triangles of a draw being recorded into a display
+ * list into strips, welding identical vertices together first */
+static void stripifyTarget(SubmissionTarget* target) {
+    Vertex* it = _glSubmissionTargetStart(target);
+    VertexExtra* ve = aligned_vector_at(target->extras, 0);
+
+    GLuint* triangles = (GLuint*) malloc(sizeof(GLuint) * target->count);
+    if(!triangles) {
+        return;
+    }
+
+    StripList strips;
+    GLboolean ok = _glWeldVertices(it, ve, target->count, triangles) &&
+        _glStripify(triangles, target->count, &strips);
+
+    free(triangles);
+
+    if(!ok) {
+        return;
+    }
+
+    /* Leave draws of nothing but degenerate triangles as they were */
+    if(strips.count) {
+        const Vertex* src;
+        const VertexExtra* esrc;
+        copyToScratch(it, ve, target->count, &src, &esrc);
+
+        /* There are never more strip vertices than triangle vertices */
+        for(GLuint i = 0; i < strips.count; ++i) {
+            it[i] = src[strips.indices[i]];
+            it[i].flags = GPU_CMD_VERTEX;
+            ve[i] = esrc[strips.indices[i]];
+        }
+
+        genStrips(it, &strips);
+
+        target->count = strips.count;
+        aligned_vector_resize(&target->output->vector, target->start_offset + strips.count);
+        aligned_vector_resize(target->extras, strips.count);
+    }
+
+    _glFreeStripList(&strips);
+}
+
+/* Returns the largest index of the draw. Indices in an element buffer
+ * are only scanned again when the range or its data changed. */
+static GLuint _glMaxIndex(const GLsizei first, const GLuint count, const GLubyte* indices, const GLenum type) {
+    const GLsizei istride = byte_size(type);
+    const IndexParseFunc IndexFunc = _calcParseIndexFunc(type);
+
+    BufferObject* buffer = _glGetBufferObject(_glGetBoundElementBuffer());
+    const GLsizeiptrARB start = (buffer) ? (indices - buffer->data) + (first * istride) : 0;
+
+    if(buffer && buffer->max_index_valid && buffer->max_index_version == buffer->version &&
+        buffer->max_index_type == type && buffer->max_index_first == start && buffer->max_index_count == count) {
+        return buffer->max_index;
+    }
+
+    GLuint result = 0;
+    for(GLuint i = first; i < first + count; ++i) {
+        const GLuint idx = IndexFunc(indices + (i * istride));
+        result = (idx > result) ? idx : result;
+    }
+
+    if(buffer) {
+        buffer->max_index_valid = GL_TRUE;
+        buffer->max_index_version = buffer->version;
+        buffer->max_index_type = type;
+        buffer->max_index_first = start;
+        buffer->max_index_count = count;
+        buffer->max_index = result;
+    }
+
+    return result;
+}
+
+/* Generates the vertices of the draw, transformed by the loaded matrix */
+static void generate(SubmissionTarget* target, const BufferObject* converted, const GLenum mode, const GLsizei first,
+        const GLuint count, const GLubyte* indices, const GLenum type) {
+    /* Read from the client buffers and generate an array of ClipVertices */
+    TRACE();
+
+    if(indices) {
+        _glVertexCacheInvalidate();
+    }
+
+    /* Only the converted buffers and generateArrays normalize as they read */
+    target->normalized = GL_FALSE;
+
+    if(converted) {
+        target->normalized = _glIsNormalizeEnabled();
+
+        if(indices) {
+            generateElementsFromBuffer(target, converted, first, count, indices, type);
+        } else {
+            generateArraysFromBuffer(target, converted, first, count);
+        }
+    } else if(FAST_PATH_ENABLED) {
+        if(indices) {
+            generateElementsFastPath(target, first, count, indices, type);
+        } else {
+            generateArraysFastPath(target, first, count);
+        }
+    } else if(indices) {
+        generateElements(target, first, count, indices, type);
+    } else {
+        target->normalized = _glIsNormalizeEnabled();
+        generateArrays(target, first, count);
+    }
+
+    Vertex* it = _glSubmissionTargetStart(target);
+    // Drawing arrays
+    switch(mode) {
+    case GL_TRIANGLES:
+        genTriangles(it, count);
+        break;
+    case GL_QUADS:
+        genQuads(it, count);
+        break;
+    case GL_TRIANGLE_FAN:
+        genTriangleFan(it, aligned_vector_at(target->extras, 0), count);
+        break;
+    case GL_POLYGON:
+        genPolygon(it, aligned_vector_at(target->extras, 0), count);
+        break;
+    case GL_TRIANGLE_STRIP:
+        genTriangleStrip(it, count);
+        break;
+    default:
+        assert(0 && "Not Implemented");
+    }
+}
+
+static void transform(SubmissionTarget* target) {
+    TRACE();
+
+    /* Perform modelview transform, storing W */
+    Vertex* vertex = _glSubmissionTargetStart(target);
+
+    TransformVertices(vertex, target->count);
+}
+
+static void clip(SubmissionTarget* target) {
+    TRACE();
+
+    /* Perform clipping, generating new vertices as necessary */
+    _glClipTriangleStrip(target, _glGetShadeModel() == GL_FLAT);
+
+    /* Reset the count now that we may have added vertices */
+    target->count = target->output->vector.size - target->start_offset;
+}
+
+static void mat_transform3(const float* xyz, const float* xyzOut, const uint32_t count, const uint32_t inStride, const uint32_t outStride) {
+    const uint8_t* dataIn = (const uint8_t*) xyz;
+    uint8_t* dataOut = (uint8_t*) xyzOut;
+
+    ITERATE(count) {
+        const float* in = (const float*) dataIn;
+        float* out = (float*) dataOut;
+
+        TransformVec3NoMod(
+            in,
+            out
+        );
+
+        dataIn += inStride;
+        dataOut += outStride;
+    }
+}
+
+static void mat_transform_normal3(const float* xyz, const float* xyzOut, const uint32_t count, const uint32_t inStride, const uint32_t outStride) {
+    const uint8_t* dataIn = (const uint8_t*) xyz;
+    uint8_t* dataOut = (uint8_t*) xyzOut;
+
+    ITERATE(count) {
+        const float* in = (const float*) dataIn;
+        float* out = (float*) dataOut;
+
+        TransformNormalNoMod(in, out);
+
+        dataIn += inStride;
+        dataOut += outStride;
+    }
+}
+
+static void light(SubmissionTarget* target) {
+
+    static AlignedVector* eye_space_data = NULL;
+
+    if(!eye_space_data) {
+        eye_space_data = (AlignedVector*) malloc(sizeof(AlignedVector));
+        aligned_vector_init(eye_space_data, sizeof(EyeSpaceData));
+    }
+
+    aligned_vector_resize(eye_space_data, target->count);
+
+    /* Perform lighting calculations and manipulate the colour */
+    Vertex* vertex = _glSubmissionTargetStart(target);
+    VertexExtra* extra = aligned_vector_at(target->extras, 0);
+    EyeSpaceData* eye_space = (EyeSpaceData*) eye_space_data->data;
+
+    _glMatrixLoadNormal();
+    mat_transform_normal3(extra->nxyz, eye_space->n, target->count, sizeof(VertexExtra), sizeof(EyeSpaceData));
+
+    /* Uniform scaling keeps the length of normals that were normalized on read */
+    if(_glIsNormalizeEnabled() && !(target->normalized && _glNormalMatrixKeepsLength())) {
+        EyeSpaceData* it = eye_space;
+        ITERATE(target->count) {
+            normalizeNormal(it->n);
+            ++it;
+        }
+    }
+
+    EyeSpaceData* ES = aligned_vector_at(eye_space_data, 0);
+    _glPerformLighting(vertex, ES, target->count);
+}
 
 GL_FORCE_INLINE void divide(SubmissionTarget* target) {
     TRACE();
@@ -1149,24 +1700,7 @@ GL_FORCE_INLINE void push(PolyHeader* header, GLboolean multiTextureHeader, Poly
 
 #define DEBUG_CLIPPING 0
 
-GL_FORCE_INLINE void submitVertices(GLenum mode, GLsizei first, GLuint count, GLenum type, const GLvoid* indices) {
-    TRACE();
-
-    /* Do nothing if vertices aren't enabled */
-    if(!(ENABLED_VERTEX_ATTRIBUTES & VERTEX_ENABLED_FLAG)) {
-        return;
-    }
-
-    /* No vertices? Do nothing */
-    if(!count) {
-        return;
-    }
-
-    if(mode == GL_LINE_STRIP || mode == GL_LINES) {
-        fprintf(stderr, "Line drawing is currently unsupported\n");
-        return;
-    }
-
+static SubmissionTarget* _glGetSubmissionTarget() {
     static SubmissionTarget* target = NULL;
     static AlignedVector extras;
 
@@ -1176,78 +1710,302 @@ GL_FORCE_INLINE void submitVertices(GLenum mode, GLsizei first, GLuint count, GL
         target->extras = NULL;
         target->count = 0;
         target->output = NULL;
+        target->normalized = GL_FALSE;
         target->header_offset = target->start_offset = 0;
 
         aligned_vector_init(&extras, sizeof(VertexExtra));
         target->extras = &extras;
     }
 
-    GLboolean doMultitexture, doTexture, doLighting;
-    GLint activeTexture;
-    glGetIntegerv(GL_ACTIVE_TEXTURE_ARB, &activeTexture);
-
-    glActiveTextureARB(GL_TEXTURE0);
-    glGetBooleanv(GL_TEXTURE_2D, &doTexture);
+    return target;
+}
 
-    glActiveTextureARB(GL_TEXTURE1);
-    glGetBooleanv(GL_TEXTURE_2D, &doMultitexture);
+/* The compiled headers for the OP, PT and TR lists, then the multitexture
+ * header for the TR list. A set bit in HEADERS_DIRTY means that header
+ * has to be compiled again. */
+static PolyHeader HEADER_CACHE[4];
+static GLuint HEADERS_DIRTY = HEADER_DIRTY_ALL;
 
-    doLighting = _glIsLightingEnabled();
+void _glMarkPolyHeadersDirty(GLuint mask) {
+    HEADERS_DIRTY |= mask;
+}
 
-    glActiveTextureARB(activeTexture);
+static const PolyHeader* _glCompiledHeader(PolyList* list, GLboolean multiTextureHeader) {
+    const GLuint i = (multiTextureHeader) ? 3 :
+        (list->list_type == GPU_LIST_OP_POLY) ? 0 :
+        (list->list_type == GPU_LIST_PT_POLY) ? 1 : 2;
 
-    /* Polygons are treated as triangle fans, the only time this would be a
-     * problem is if we supported glPolygonMode(..., GL_LINE) but we don't.
-     * We optimise the triangle and quad cases.
-     */
-    if(mode == GL_POLYGON) {
-        if(count == 3) {
-            mode = GL_TRIANGLES;
-        } else if(count == 4) {
-            mode = GL_QUADS;
-        } else {
-            mode = GL_TRIANGLE_FAN;
-        }
+    if(HEADERS_DIRTY & (1u << i)) {
+        push(&HEADER_CACHE[i], multiTextureHeader, list, (multiTextureHeader) ? 1 : 0);
+        HEADERS_DIRTY &= ~(1u << i);
     }
 
-    // We don't handle this any further, so just make sure we never pass it down */
-    assert(mode != GL_POLYGON);
+    return &HEADER_CACHE[i];
+}
+
+static GLuint ELIDED_HEADERS = 0;
+static GLuint ELIDED_HEADERS_LAST_FRAME = 0;
+
+GLuint _glGetElidedHeaderCount() {
+    return ELIDED_HEADERS_LAST_FRAME;
+}
+
+void _glElidedHeadersFrameEnd() {
+    ELIDED_HEADERS_LAST_FRAME = ELIDED_HEADERS;
+    ELIDED_HEADERS = 0;
+}
 
-    target->output = _glActivePolyList();
-    target->count = (mode == GL_TRIANGLE_FAN) ? ((count - 2) * 3) : count;
-    target->header_offset = target->output->vector.size;
-    target->start_offset = target->header_offset + 1;
+/* Vertices appended to the list can be sent under its last header if
+ * nothing else was added since, and the header they need is identical */
+GL_FORCE_INLINE GLboolean _glCanCarryOnHeader(const PolyList* list, const PolyHeader* header) {
+    return list->last_end && list->last_end == list->vector.size &&
+        memcmp(aligned_vector_at(&list->vector, list->last_header), header, sizeof(PolyHeader)) == 0;
+}
+
+/* Makes room in the active poly list for a header and count vertices. The
+ * header only depends on the GL state so it's fetched here, and left out
+ * if the draw can carry on under the list's last one. start_offset is the
+ * same as header_offset then. */
+static void _glSubmissionTargetReserve(SubmissionTarget* target, GLuint count) {
+    PolyList* list = _glActivePolyList();
+    const PolyHeader* header = _glCompiledHeader(list, GL_FALSE);
+
+    const GLuint headerCount = (_glCanCarryOnHeader(list, header)) ? 0 : 1;
+
+    target->output = list;
+    target->count = count;
+    target->header_offset = list->vector.size;
+    target->start_offset = target->header_offset + headerCount;
 
     assert(target->count);
 
     /* Make sure we have enough room for all the "extra" data */
-    aligned_vector_resize(&extras, target->count);
+    aligned_vector_resize(target->extras, target->count);
 
     /* Make room for the vertices and header */
-    aligned_vector_extend(&target->output->vector, target->count + 1);
-
-    /* If we're lighting, then we need to do some work in
-     * eye-space, so we only transform vertices by the modelview
-     * matrix, and then later multiply by projection.
-     *
-     * If we're not doing lighting though we can optimise by taking
-     * vertices straight to clip-space */
+    PolyHeader* slot = (PolyHeader*) aligned_vector_extend(&list->vector, target->count + headerCount);
+    if(headerCount) {
+        *slot = *header;
+    }
+}
 
+/* If we're lighting, then we need to do some work in
+ * eye-space, so we only transform vertices by the modelview
+ * matrix, and then later multiply by projection.
+ *
+ * If we're not doing lighting though we can optimise by taking
+ * vertices straight to clip-space */
+static void loadVertexMatrix(GLboolean doLighting) {
     if(doLighting) {
         _glMatrixLoadModelView();
     } else {
         _glMatrixLoadModelViewProjection();
     }
+}
+
+/* Takes the generated vertices to clip space, lighting and clipping them */
+typedef struct {
+    float x, y, w;
+} CullVertex;
+
+/* Twice the signed area of the triangle after projection, scaled by the
+ * product of the Ws, which is positive when it's wound anti-clockwise */
+GL_FORCE_INLINE float clipSpaceArea(const CullVertex* a, const CullVertex* b, const CullVertex* c) {
+    return a->x * (b->y * c->w - c->y * b->w) -
+        a->y * (b->x * c->w - c->x * b->w) +
+        a->w * (b->x * c->y - c->x * b->y);
+}
+
+/* Writes the strips left after removing the dropped triangles. The
+ * output may be the source itself, as long as no vertex is written
+ * further along than the one being read. */
+static void emitCulledStrips(const Vertex* src, const VertexExtra* esrc, const GLubyte* drop, GLuint count,
+        Vertex* output, VertexExtra* extras) {
+#define CULL_EMIT(v, ve) \
+    do { \
+        *output = (v); \
+        (output++)->flags = GPU_CMD_VERTEX; \
+        *extras++ = (ve); \
+    } while(0)
+
+#define CULL_END() \
+    (output - 1)->flags = GPU_CMD_VERTEX_EOL
+
+    /* Set when the next kept triangle has to begin a new strip */
+    GLboolean restart = GL_TRUE;
+    GLuint start = 0;
+
+    for(GLuint i = 0; i < count; ++i) {
+        const GLuint j = i - start;
+        const GLboolean last = (src[i].flags == GPU_CMD_VERTEX_EOL);
+
+        if(j >= 2) {
+            if(drop[i]) {
+                restart = GL_TRUE;
+            } else if(!restart) {
+                CULL_EMIT(src[i], esrc[i]);
+            } else if(j & 1) {
+                /* Odd triangles are wound the other way round, so one
+                 * which begins a strip is sent by itself, reversed. The
+                 * vertices are read first as the output may overlap them. */
+                const Vertex a = src[i - 1], b = src[i - 2];
+                const VertexExtra ae = esrc[i - 1], be = esrc[i - 2];
+
+                CULL_EMIT(a, ae);
+                CULL_EMIT(b, be);
+                CULL_EMIT(src[i], esrc[i]);
+                CULL_END();
+            } else {
+                CULL_EMIT(src[i - 2], esrc[i - 2]);
+                CULL_EMIT(src[i - 1], esrc[i - 1]);
+                CULL_EMIT(src[i], esrc[i]);
+                restart = GL_FALSE;
+            }
+
+            /* End the strip here if the next triangle is gone */
+            if(!restart && (last || drop[i + 1])) {
+                CULL_END();
+                restart = GL_TRUE;
+            }
+        }
+
+        if(last) {
+            start = i + 1;
+            restart = GL_TRUE;
+        }
+    }
+
+#undef CULL_END
+#undef CULL_EMIT
+}
+
+/* Drops the triangles which the hardware would cull, splitting strips
+ * around them. If projection is set the vertices are in eye space and
+ * it's used to find their clip space positions. */
+static void cull(SubmissionTarget* target, GPUCulling mode, const Matrix4x4* projection) {
+    static AlignedVector positions;
+    static AlignedVector culled;
+
+    if(!positions.element_size) {
+        aligned_vector_init(&positions, sizeof(CullVertex));
+        aligned_vector_init(&culled, sizeof(GLubyte));
+    }
+
+    const GLuint count = target->count;
+    Vertex* it = _glSubmissionTargetStart(target);
+
+    aligned_vector_resize(&positions, count);
+    aligned_vector_resize(&culled, count);
+
+    CullVertex* pos = (CullVertex*) positions.data;
+    GLubyte* drop = (GLubyte*) culled.data;
+
+    GLuint i;
+    if(projection) {
+        const float* m = (const float*) projection;
+        for(i = 0; i < count; ++i) {
+            const float* v = it[i].xyz;
+            pos[i].x = m[0] * v[0] + m[4] * v[1] + m[8] * v[2] + m[12];
+            pos[i].y = m[1] * v[0] + m[5] * v[1] + m[9] * v[2] + m[13];
+            pos[i].w = m[3] * v[0] + m[7] * v[1] + m[11] * v[2] + m[15];
+        }
+    } else {
+        for(i = 0; i < count; ++i) {
+            pos[i].x = it[i].xyz[0];
+            pos[i].y = it[i].xyz[1];
+            pos[i].w = it[i].w;
+        }
+    }
+
+    /* Screen space Y points down, so the hardware's clockwise is
+     * anti-clockwise here */
+    const float sign = (mode == GPU_CULLING_CW) ? -1.0f : 1.0f;
+    GLuint dropped = 0;
+    GLuint start = 0;
+
+    /* The vertices emitCulledStrips will write, splitting a strip can
+     * need more than it had. Unless that ever puts a vertex ahead of the
+     * one it's copied from the strips can be rewritten in place, which is
+     * always true of triangle and quad lists. */
+    GLuint outputCount = 0;
+    GLboolean restart = GL_TRUE;
+    GLboolean inPlace = GL_TRUE;
+
+    /* drop[i] is set if the triangle ending at vertex i is culled */
+    for(i = 0; i < count; ++i) {
+        drop[i] = 0;
+
+        const GLuint j = i - start;
+
+        if(j >= 2) {
+            /* Triangles crossing W = 0 are left to the clipper */
+            if(pos[i - 2].w > 0.0f && pos[i - 1].w > 0.0f && pos[i].w > 0.0f) {
+                const float area = clipSpaceArea(pos + i - 2, pos + i - 1, pos + i);
+                drop[i] = (area * ((j & 1) ? -sign : sign)) <= 0.0f;
+                dropped += drop[i];
+            }
+
+            if(drop[i]) {
+                restart = GL_TRUE;
+            } else if(restart) {
+                inPlace = inPlace && outputCount <= i - 2;
+                outputCount += 3;
+                restart = (j & 1);
+            } else {
+                inPlace = inPlace && outputCount <= i;
+                outputCount += 1;
+            }
+        }
+
+        if(it[i].flags == GPU_CMD_VERTEX_EOL) {
+            start = i + 1;
+            restart = GL_TRUE;
+        }
+    }
+
+    if(!dropped) {
+        return;
+    }
+
+    VertexExtra* ve = aligned_vector_at(target->extras, 0);
+
+    if(inPlace) {
+        emitCulledStrips(it, ve, drop, count, it, ve);
+    } else {
+        const Vertex* src;
+        const VertexExtra* esrc;
+        copyToScratch(it, ve, count, &src, &esrc);
+
+        aligned_vector_resize(&target->output->vector, target->start_offset + outputCount);
+        aligned_vector_resize(target->extras, outputCount);
+
+        emitCulledStrips(
+            src, esrc, drop, count,
+            _glSubmissionTargetStart(target), aligned_vector_at(target->extras, 0)
+        );
+    }
 
-    /* If we're FAST_PATH_ENABLED, then this will do the transform for us */
-    generate(target, mode, first, count, (GLubyte*) indices, type);
+    aligned_vector_resize(&target->output->vector, target->start_offset + outputCount);
+    aligned_vector_resize(target->extras, outputCount);
+    target->count = outputCount;
+}
 
-    /* No fast path, then we have to do another iteration :( */
-    if(!FAST_PATH_ENABLED) {
+static void transformAndClip(SubmissionTarget* target, GLboolean transformed, GLboolean doLighting, GLboolean doClipping) {
+    /* Display list chunks are stored in object space */
+    if(!transformed) {
         /* Multiply by modelview */
         transform(target);
     }
 
+    const GPUCulling cullMode = _glGetCpuCullMode();
+    if(cullMode != GPU_CULLING_NONE) {
+        cull(target, cullMode, (doLighting) ? _glGetProjectionMatrix() : NULL);
+
+        if(!target->count) {
+            return;
+        }
+    }
+
     if(doLighting){
         light(target);
 
@@ -1256,7 +2014,7 @@ GL_FORCE_INLINE void submitVertices(GLenum mode, GLsizei first, GLuint count, GL
         transform(target);
     }
 
-    if(_glIsClippingEnabled()) {
+    if(doClipping) {
 #if DEBUG_CLIPPING
         uint32_t i = 0;
         fprintf(stderr, "=========\n");
@@ -1273,7 +2031,7 @@ GL_FORCE_INLINE void submitVertices(GLenum mode, GLsizei first, GLuint count, GL
 
         clip(target);
 
-        assert(extras.size == target->count);
+        assert(target->extras->size == target->count);
 
 #if DEBUG_CLIPPING
         fprintf(stderr, "--------\n");
@@ -1288,8 +2046,26 @@ GL_FORCE_INLINE void submitVertices(GLenum mode, GLsizei first, GLuint count, GL
 #endif
 
     }
+}
 
-    push(_glSubmissionTargetHeader(target), GL_FALSE, target->output, 0);
+/* Compiles the header for the target, and sends the vertices a second
+ * time if multitexturing. attributes are the arrays the vertices were
+ * generated from. */
+static void pushTarget(SubmissionTarget* target, GLboolean doMultitexture, GLuint attributes) {
+    /* Everything was culled or clipped away, so drop the header too */
+    if(!target->count) {
+        aligned_vector_resize(&target->output->vector, target->header_offset);
+        return;
+    }
+
+    PolyList* list = target->output;
+    if(target->start_offset == target->header_offset) {
+        ++ELIDED_HEADERS;
+    } else {
+        list->last_header = target->header_offset;
+    }
+
+    list->last_end = list->vector.size;
 
     /*
        Now, if multitexturing is enabled, we want to send exactly the same vertices again, except:
@@ -1307,33 +2083,383 @@ GL_FORCE_INLINE void submitVertices(GLenum mode, GLsizei first, GLuint count, GL
     TextureObject* texture1 = _glGetTexture1();
 
     /* Multitexture implicitly disabled */
-    if(!texture1 || ((ENABLED_VERTEX_ATTRIBUTES & ST_ENABLED_FLAG) != ST_ENABLED_FLAG)) {
+    if(!texture1 || ((attributes & ST_ENABLED_FLAG) != ST_ENABLED_FLAG)) {
         /* Multitexture actively disabled */
         return;
     }
 
-    /* Push back a copy of the list to the transparent poly list, including the header
-        (hence the + 1)
-    */
-    Vertex* vertex = aligned_vector_push_back(
-        &_glTransparentPolyList()->vector, (Vertex*) _glSubmissionTargetHeader(target), target->count + 1
-    );
+    /* Push back a copy of the vertices to the transparent poly list, under
+     * a header for the second texture unless it can carry on under the
+     * last one */
+    PolyList* trList = _glTransparentPolyList();
+
+    const PolyHeader* mtHeader = _glCompiledHeader(trList, GL_TRUE);
+
+    const GLuint headerCount = (_glCanCarryOnHeader(trList, mtHeader)) ? 0 : 1;
+    const uint32_t headerOffset = trList->vector.size;
+
+    Vertex* vertex = aligned_vector_extend(&trList->vector, target->count + headerCount);
 
     assert(vertex);
 
-    PolyHeader* mtHeader = (PolyHeader*) vertex++;
+    if(headerCount) {
+        *((PolyHeader*) vertex++) = *mtHeader;
+        trList->last_header = headerOffset;
+    } else {
+        ++ELIDED_HEADERS;
+    }
+
+    trList->last_end = trList->vector.size;
 
-    /* Replace the UV coordinates with the ST ones */
+    /* Copy the vertices, replacing the UV coordinates with the ST ones. The
+     * source is found again as extending the list could have moved it. */
+    const Vertex* src = _glSubmissionTargetStart(target);
     VertexExtra* ve = aligned_vector_at(target->extras, 0);
     ITERATE(target->count) {
+        *vertex = *src++;
         vertex->uv[0] = ve->st[0];
         vertex->uv[1] = ve->st[1];
         ++vertex;
         ++ve;
     }
+}
+
+/* The volume passed to glBoundingSphereKOS or glBoundingBoxKOS, which
+ * applies to the next draw only. Both are kept as a centre in object
+ * space, with the radius or the half size of the box. */
+typedef struct {
+    GLboolean set;
+    GLboolean sphere;
+    GLfloat centre[3];
+    GLfloat extent[3];
+} BoundingVolume;
+
+static BoundingVolume BOUNDING_VOLUME = {GL_FALSE, GL_FALSE, {0, 0, 0}, {0, 0, 0}};
+
+typedef enum {
+    VOLUME_OUTSIDE,
+    VOLUME_CROSSES_NEAR,
+    VOLUME_IN_FRONT_OF_NEAR
+} VolumeTest;
+
+/* Tests the volume against the planes of the frustum, taken from the rows
+ * of the modelview-projection matrix so no vertex needs transforming. The
+ * clipper only clips against the near plane, so that's the only one the
+ * volume has to be in front of for clipping to be skipped. */
+static VolumeTest testBoundingVolume(const BoundingVolume* volume) {
+    const float* m = (const float*) _glGetModelViewProjectionMatrix();
+    const float* c = volume->centre;
+    const float* e = volume->extent;
+
+    VolumeTest result = VOLUME_IN_FRONT_OF_NEAR;
+
+    /* w + x, w - x, w + y, w - y, w + z (near), w - z (far) */
+    GLuint i;
+    for(i = 0; i < 6; ++i) {
+        const GLuint row = i >> 1;
+        const float s = (i & 1) ? -1.0f : 1.0f;
+
+        const float a = m[3] + s * m[row];
+        const float b = m[7] + s * m[row + 4];
+        const float cc = m[11] + s * m[row + 8];
+        const float d = m[15] + s * m[row + 12];
+
+        const float distance = a * c[0] + b * c[1] + cc * c[2] + d;
+
+        /* How far the volume reaches towards the plane, in the same units */
+        const float reach = (volume->sphere) ?
+            e[0] * sqrtf(a * a + b * b + cc * cc) :
+            fabsf(a) * e[0] + fabsf(b) * e[1] + fabsf(cc) * e[2];
+
+        if(distance + reach < 0.0f) {
+            return VOLUME_OUTSIDE;
+        }
+
+        if(i == 4 && distance - reach < 0.0f) {
+            result = VOLUME_CROSSES_NEAR;
+        }
+    }
+
+    return result;
+}
+
+GL_FORCE_INLINE void submitVertices(GLenum mode, GLsizei first, GLuint count, GLenum type, const GLvoid* indices) {
+    TRACE();
+
+    /* The bounding volume is used up by this draw whatever happens */
+    const BoundingVolume volume = BOUNDING_VOLUME;
+    BOUNDING_VOLUME.set = GL_FALSE;
+
+    /* Do nothing if vertices aren't enabled */
+    if(!(ENABLED_VERTEX_ATTRIBUTES & VERTEX_ENABLED_FLAG)) {
+        return;
+    }
+
+    /* No vertices? Do nothing */
+    if(!count) {
+        return;
+    }
+
+    if(mode == GL_LINE_STRIP || mode == GL_LINES) {
+        fprintf(stderr, "Line drawing is currently unsupported\n");
+        return;
+    }
+
+    /* Arrays that run past the end of the converted buffer are read from
+     * the client data instead */
+    const BufferObject* converted = _glConvertedBuffer();
+    if(converted && !indices && first + count > converted->converted_count) {
+        converted = NULL;
+    }
+
+    /* An index past the end of a converted buffer would read past the
+     * end of its vertices, so the draw is rejected instead */
+    if(converted && indices && _glMaxIndex(first, count, indices, type) >= converted->converted_count) {
+        _glKosThrowError(GL_INVALID_OPERATION, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    SubmissionTarget* target = _glGetSubmissionTarget();
+
+    const DrawState* state = _glGetDrawState();
+    const GLboolean doMultitexture = state->multitexture;
+    const GLboolean doLighting = state->lighting;
+
+    /* Polygons are sent as zig-zag strips, the only time this would be a
+     * problem is if we supported glPolygonMode(..., GL_LINE) but we don't.
+     * We optimise the triangle and quad cases.
+     */
+    if(mode == GL_POLYGON) {
+        if(count == 3) {
+            mode = GL_TRIANGLES;
+        } else if(count == 4) {
+            mode = GL_QUADS;
+        }
+    }
+
+    if((mode == GL_TRIANGLE_FAN || mode == GL_POLYGON) && count < 3) {
+        return;
+    }
+
+    /* Display lists record the vertices in object space */
+    const GLenum listMode = _glGetListMode();
+
+    /* Lists always record the draw, so the volume isn't used for them */
+    GLboolean doClipping = _glIsClippingEnabled();
+    if(volume.set && !listMode) {
+        const VolumeTest test = testBoundingVolume(&volume);
+        if(test == VOLUME_OUTSIDE) {
+            return;
+        }
+
+        if(test == VOLUME_IN_FRONT_OF_NEAR) {
+            doClipping = GL_FALSE;
+        }
+    }
+
+    /* The strip order changes which vertex provokes each triangle */
+    const GLboolean stripify = mode == GL_TRIANGLES && _glIsStripifyEnabled() && _glGetShadeModel() != GL_FLAT;
+
+    const StripList* strips = (stripify && !listMode) ? _glBufferStrips(converted, first, count, indices, type) : NULL;
+    if(strips) {
+        if(!strips->count) {
+            return;
+        }
+
+        mode = GL_TRIANGLE_STRIP;
+        first = 0;
+        count = strips->count;
+        indices = strips->indices;
+        type = GL_UNSIGNED_INT;
+    }
+
+    _glSubmissionTargetReserve(target, (mode == GL_TRIANGLE_FAN) ? fanVertexCount(count) : count);
+
+    if(listMode) {
+        _glMatrixLoadIdentity();
+    } else {
+        loadVertexMatrix(doLighting);
+    }
+
+    /* Every generate path transforms as it goes */
+    generate(target, converted, mode, first, count, (GLubyte*) indices, type);
+    GLboolean transformed = GL_TRUE;
+
+    if(strips) {
+        genStrips(_glSubmissionTargetStart(target), strips);
+    }
+
+    if(listMode) {
+        /* The shade model when the list is called decides whether the
+         * triangles are stripified, so they're recorded as they are */
+        _glRecordListChunk(
+            _glSubmissionTargetStart(target), aligned_vector_at(target->extras, 0),
+            target->count, ENABLED_VERTEX_ATTRIBUTES, mode,
+            mode == GL_TRIANGLES && _glIsStripifyEnabled()
+        );
+
+        if(listMode == GL_COMPILE) {
+            /* Recorded only, drop the vertices and header again */
+            aligned_vector_resize(&target->output->vector, target->header_offset);
+            return;
+        }
+
+        if(stripify) {
+            stripifyTarget(target);
+        }
+
+        loadVertexMatrix(doLighting);
+        transformed = GL_FALSE;
+    }
+
+    if(_glGetShadeModel() == GL_FLAT) {
+        flatShadeStrips(_glSubmissionTargetStart(target), target->count, mode);
+    }
+
+    transformAndClip(target, transformed, doLighting, doClipping);
+    pushTarget(target, doMultitexture, ENABLED_VERTEX_ATTRIBUTES);
+}
+
+static GLboolean _glChunkMatricesMatch(DisplayListChunk* chunk) {
+    const GLuint modelview = _glMatrixVersion(GL_MODELVIEW);
+    const GLuint projection = _glMatrixVersion(GL_PROJECTION);
+
+    if(chunk->output_modelview_version == modelview && chunk->output_projection_version == projection) {
+        return GL_TRUE;
+    }
+
+    /* Apps often rebuild the same matrices every frame, so the versions
+     * moving on doesn't mean the values did */
+    if(memcmp(chunk->output_modelview, _glGetModelViewMatrix(), sizeof(Matrix4x4)) == 0 &&
+        memcmp(chunk->output_projection, _glGetProjectionMatrix(), sizeof(Matrix4x4)) == 0) {
+        chunk->output_modelview_version = modelview;
+        chunk->output_projection_version = projection;
+        return GL_TRUE;
+    }
+
+    return GL_FALSE;
+}
+
+/* Clip space output can be reused while nothing that affects it changed */
+static GLboolean _glChunkOutputValid(DisplayListChunk* chunk, GLboolean doLighting) {
+    return chunk->output_valid && !doLighting &&
+        chunk->output_flat == (_glGetShadeModel() == GL_FLAT) &&
+        chunk->output_clipped == _glIsClippingEnabled() &&
+        chunk->output_cull == _glGetCpuCullMode() &&
+        _glChunkMatricesMatch(chunk);
+}
+
+static void _glStoreChunkOutput(DisplayListChunk* chunk, SubmissionTarget* target) {
+    if(target->count > chunk->output_capacity) {
+        Vertex* output = (Vertex*) realloc(chunk->output, sizeof(Vertex) * target->count);
+        VertexExtra* extras = (VertexExtra*) realloc(chunk->output_extras, sizeof(VertexExtra) * target->count);
+
+        if(output) {
+            chunk->output = output;
+        }
+
+        if(extras) {
+            chunk->output_extras = extras;
+        }
+
+        if(!output || !extras) {
+            chunk->output_valid = GL_FALSE;
+            return;
+        }
+
+        chunk->output_capacity = target->count;
+    }
+
+    chunk->output_count = target->count;
+    memcpy(chunk->output, _glSubmissionTargetStart(target), sizeof(Vertex) * target->count);
+    memcpy(chunk->output_extras, target->extras->data, sizeof(VertexExtra) * target->count);
+
+    chunk->output_flat = (_glGetShadeModel() == GL_FLAT);
+    chunk->output_clipped = _glIsClippingEnabled();
+    chunk->output_cull = _glGetCpuCullMode();
+    memcpy(chunk->output_modelview, _glGetModelViewMatrix(), sizeof(Matrix4x4));
+    memcpy(chunk->output_projection, _glGetProjectionMatrix(), sizeof(Matrix4x4));
+    chunk->output_modelview_version = _glMatrixVersion(GL_MODELVIEW);
+    chunk->output_projection_version = _glMatrixVersion(GL_PROJECTION);
+    chunk->output_valid = GL_TRUE;
+}
+
+/* Keeps the stripified vertices of a chunk for its next smooth shaded call */
+static void _glStoreChunkStrips(DisplayListChunk* chunk, SubmissionTarget* target) {
+    chunk->strip_vertices = (Vertex*) malloc(sizeof(Vertex) * target->count);
+    chunk->strip_extras = (VertexExtra*) malloc(sizeof(VertexExtra) * target->count);
+
+    if(!chunk->strip_vertices || !chunk->strip_extras) {
+        free(chunk->strip_vertices);
+        free(chunk->strip_extras);
+        chunk->strip_vertices = NULL;
+        chunk->strip_extras = NULL;
+        return;
+    }
+
+    chunk->strip_count = target->count;
+    memcpy(chunk->strip_vertices, _glSubmissionTargetStart(target), sizeof(Vertex) * target->count);
+    memcpy(chunk->strip_extras, target->extras->data, sizeof(VertexExtra) * target->count);
+}
+
+void _glSubmitDisplayListChunk(DisplayListChunk* chunk) {
+    TRACE();
+
+    if(!chunk->count) {
+        return;
+    }
+
+    SubmissionTarget* target = _glGetSubmissionTarget();
+
+    const DrawState* state = _glGetDrawState();
+    const GLboolean doMultitexture = state->multitexture;
+    const GLboolean doLighting = state->lighting;
+
+    if(_glChunkOutputValid(chunk, doLighting)) {
+        /* Same matrices as last time, the clip space output can be copied */
+        if(!chunk->output_count) {
+            return;
+        }
+
+        _glSubmissionTargetReserve(target, chunk->output_count);
+
+        memcpy(_glSubmissionTargetStart(target), chunk->output, sizeof(Vertex) * chunk->output_count);
+        memcpy(target->extras->data, chunk->output_extras, sizeof(VertexExtra) * chunk->output_count);
+    } else {
+        const GLboolean flat = (_glGetShadeModel() == GL_FLAT);
+        const GLboolean stripped = chunk->stripify && !flat && chunk->strip_vertices;
+
+        const GLuint count = (stripped) ? chunk->strip_count : chunk->count;
+        _glSubmissionTargetReserve(target, count);
+
+        memcpy(_glSubmissionTargetStart(target), (stripped) ? chunk->strip_vertices : chunk->vertices, sizeof(Vertex) * count);
+        memcpy(target->extras->data, (stripped) ? chunk->strip_extras : chunk->extras, sizeof(VertexExtra) * count);
+
+        if(chunk->stripify && !flat && !stripped) {
+            stripifyTarget(target);
+            _glStoreChunkStrips(chunk, target);
+        }
+
+        if(flat) {
+            flatShadeStrips(_glSubmissionTargetStart(target), target->count, chunk->mode);
+        }
+
+        /* Chunks keep the normals as they were submitted */
+        target->normalized = GL_FALSE;
+
+        loadVertexMatrix(doLighting);
+        transformAndClip(target, GL_FALSE, doLighting, _glIsClippingEnabled());
+
+        /* Lit colours depend on more state than we track */
+        if(doLighting) {
+            chunk->output_valid = GL_FALSE;
+        } else {
+            _glStoreChunkOutput(chunk, target);
+        }
+    }
 
-    /* Send the buffer again to the transparent list */
-    push(mtHeader, GL_TRUE, _glTransparentPolyList(), 1);
+    pushTarget(target, doMultitexture, chunk->attributes);
 }
 
 void APIENTRY glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid* indices) {
@@ -1343,6 +2469,13 @@ void APIENTRY glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvo
         return;
     }
     _glRecalcFastPath();
+    _glResolveBufferPointers();
+
+    /* With an element buffer bound, indices is an offset into it */
+    BufferObject* elements = _glGetBufferObject(_glGetBoundElementBuffer());
+    if(elements) {
+        indices = elements->data + (size_t) indices;
+    }
 
     submitVertices(mode, 0, count, type, indices);
 }
@@ -1354,10 +2487,55 @@ void APIENTRY glDrawArrays(GLenum mode, GLint first, GLsizei count) {
         return;
     }
     _glRecalcFastPath();
+    _glResolveBufferPointers();
 
     submitVertices(mode, first, count, GL_UNSIGNED_INT, NULL);
 }
 
+void APIENTRY glBoundingSphereKOS(GLfloat x, GLfloat y, GLfloat z, GLfloat radius) {
+    TRACE();
+
+    if(_glCheckImmediateModeInactive(__func__)) {
+        return;
+    }
+
+    if(radius < 0.0f) {
+        _glKosThrowError(GL_INVALID_VALUE, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    BOUNDING_VOLUME.set = GL_TRUE;
+    BOUNDING_VOLUME.sphere = GL_TRUE;
+    BOUNDING_VOLUME.centre[0] = x;
+    BOUNDING_VOLUME.centre[1] = y;
+    BOUNDING_VOLUME.centre[2] = z;
+    BOUNDING_VOLUME.extent[0] = BOUNDING_VOLUME.extent[1] = BOUNDING_VOLUME.extent[2] = radius;
+}
+
+void APIENTRY glBoundingBoxKOS(GLfloat minX, GLfloat minY, GLfloat minZ, GLfloat maxX, GLfloat maxY, GLfloat maxZ) {
+    TRACE();
+
+    if(_glCheckImmediateModeInactive(__func__)) {
+        return;
+    }
+
+    if(minX > maxX || minY > maxY || minZ > maxZ) {
+        _glKosThrowError(GL_INVALID_VALUE, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    BOUNDING_VOLUME.set = GL_TRUE;
+    BOUNDING_VOLUME.sphere = GL_FALSE;
+    BOUNDING_VOLUME.centre[0] = (minX + maxX) * 0.5f;
+    BOUNDING_VOLUME.centre[1] = (minY + maxY) * 0.5f;
+    BOUNDING_VOLUME.centre[2] = (minZ + maxZ) * 0.5f;
+    BOUNDING_VOLUME.extent[0] = (maxX - minX) * 0.5f;
+    BOUNDING_VOLUME.extent[1] = (maxY - minY) * 0.5f;
+    BOUNDING_VOLUME.extent[2] = (maxZ - minZ) * 0.5f;
+}
+
 void APIENTRY glEnableClientState(GLenum cap) {
     TRACE();
 
@@ -1439,7 +2617,8 @@ void APIENTRY glTexCoordPointer(GLint size,  GLenum type,  GLsizei stride,  cons
 
     AttribPointer* tointer = (ACTIVE_CLIENT_TEXTURE == 0) ? &UV_POINTER : &ST_POINTER;
 
-    tointer->ptr = pointer;
+    tointer->ptr = tointer->offset = pointer;
+    tointer->buffer = _glGetBoundArrayBuffer();
     tointer->stride = (stride) ? stride : size * byte_size(type);
     tointer->type = type;
     tointer->size = size;
@@ -1454,7 +2633,8 @@ void APIENTRY glVertexPointer(GLint size, GLenum type,  GLsizei stride,  const G
         return;
     }
 
-    VERTEX_POINTER.ptr = pointer;
+    VERTEX_POINTER.ptr = VERTEX_POINTER.offset = pointer;
+    VERTEX_POINTER.buffer = _glGetBoundArrayBuffer();
     VERTEX_POINTER.stride = (stride) ? stride : (size * byte_size(VERTEX_POINTER.type));
     VERTEX_POINTER.type = type;
     VERTEX_POINTER.size = size;
@@ -1470,10 +2650,11 @@ void APIENTRY glColorPointer(GLint size,  GLenum type,  GLsizei stride,  const G
     }
 
 
-    DIFFUSE_POINTER.ptr = pointer;
+    DIFFUSE_POINTER.ptr = DIFFUSE_POINTER.offset = pointer;
+    DIFFUSE_POINTER.buffer = _glGetBoundArrayBuffer();
     DIFFUSE_POINTER.type = type;
-    DIFFUSE_POINTER.size = (DIFFUSE_POINTER.size == GL_BGRA) ? 4 : size;
-    DIFFUSE_POINTER.stride = (stride) ? stride : DIFFUSE_POINTER.size * byte_size(type);
+    DIFFUSE_POINTER.size = size;
+    DIFFUSE_POINTER.stride = (stride) ? stride : diffusePointerSize() * byte_size(type);
 }
 
 void APIENTRY glNormalPointer(GLenum type,  GLsizei stride,  const GLvoid * pointer) {
@@ -1494,7 +2675,8 @@ void APIENTRY glNormalPointer(GLenum type,  GLsizei stride,  const GLvoid * poin
         return;
     }
 
-    NORMAL_POINTER.ptr = pointer;
+    NORMAL_POINTER.ptr = NORMAL_POINTER.offset = pointer;
+    NORMAL_POINTER.buffer = _glGetBoundArrayBuffer();
     NORMAL_POINTER.size = (type == GL_UNSIGNED_INT_2_10_10_10_REV) ? 1 : 3;
     NORMAL_POINTER.stride = (stride) ? stride : NORMAL_POINTER.size * byte_size(type);
     NORMAL_POINTER.type = type;
@@ -1,4 +1,6 @@
 
+#include <stdlib.h>
+
 #include "../containers/aligned_vector.h"
 #include "private.h"
 
@@ -41,6 +43,7 @@ void APIENTRY glFinish() {
 void APIENTRY glKosInitConfig(GLdcConfig* config) {
     config->autosort_enabled = GL_FALSE;
     config->fsaa_enabled = GL_FALSE;
+    config->headless_enabled = (getenv("GLDC_HEADLESS") != NULL) ? GL_TRUE : GL_FALSE;
 
     config->initial_op_capacity = 1024 * 3;
     config->initial_pt_capacity = 512 * 3;
@@ -54,7 +57,7 @@ void APIENTRY glKosInitEx(GLdcConfig* config) {
 
     printf("\nWelcome to GLdc! Git revision: %s\n\n", GLDC_VERSION);
 
-    InitGPU(config->autosort_enabled, config->fsaa_enabled);
+    InitGPU(config->autosort_enabled, config->fsaa_enabled, config->headless_enabled);
 
     AUTOSORT_ENABLED = config->autosort_enabled;
 
@@ -64,6 +67,8 @@ void APIENTRY glKosInitEx(GLdcConfig* config) {
     _glInitLights();
     _glInitImmediateMode(config->initial_immediate_capacity);
     _glInitFramebuffers();
+    _glInitBuffers();
+    _glInitDisplayLists();
 
     _glSetInternalPaletteFormat(config->internal_palette_format);
 
@@ -201,5 +206,24 @@ void APIENTRY glKosSwapBuffers() {
     aligned_vector_clear(&PT_LIST.vector);
     aligned_vector_clear(&TR_LIST.vector);
 
+    OP_LIST.last_end = PT_LIST.last_end = TR_LIST.last_end = 0;
+
+    _glVertexCacheFrameEnd();
+    _glElidedHeadersFrameEnd();
+
     _glApplyScissor(true);
 }
+
+const GLuint* APIENTRY glKosGetFramebuffer(GLsizei* width, GLsizei* height) {
+    const VideoMode* mode = GetVideoMode();
+
+    if(width) {
+        *width = mode->width;
+    }
+
+    if(height) {
+        *height = mode->height;
+    }
+
+    return GPUFramebuffer();
+}
@@ -272,6 +272,8 @@ void APIENTRY glGenerateMipmapEXT(GLenum target) {
         return;
     }
 
+    _glTextureObjectChanged(tex);
+
     if(tex->width != tex->height) {
         fprintf(stderr, "[GL ERROR] Mipmaps cannot be supported on non-square textures\n");
         _glKosThrowError(GL_INVALID_OPERATION, __func__);
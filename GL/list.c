@@ -0,0 +1,287 @@
+/*
+ * Display lists record the vertices generated by each draw call made
+ * while compiling, in object space. Calling a list sends them through
+ * the remaining stages of the pipeline, or if the matrices haven't
+ * changed since the last call, copies the previous clip space output
+ * straight into the active poly list.
+ *
+ * current limitations:
+ *
+ * 1. Only geometry is recorded. State changes made while compiling take
+ *    effect immediately and aren't replayed by glCallList.
+ * 2. Polygon headers are built from the state at call time.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "private.h"
+#include "config.h"
+
+static NamedArray DISPLAY_LISTS;
+
+static GLuint LIST_INDEX = 0;
+static GLenum LIST_MODE = 0;
+static GLuint LIST_BASE = 0;
+
+/* Chunks recorded since glNewList, these replace the contents of the
+ * list on glEndList */
+static DisplayList COMPILING_LIST = {0, NULL};
+
+void _glInitDisplayLists() {
+    named_array_init(&DISPLAY_LISTS, sizeof(DisplayList), MAX_DISPLAY_LIST_COUNT);
+
+    // Reserve zero so that it is never given to anyone as an ID!
+    named_array_reserve(&DISPLAY_LISTS, 0);
+}
+
+GLenum _glGetListMode() {
+    return LIST_MODE;
+}
+
+GLuint _glGetListIndex() {
+    return LIST_INDEX;
+}
+
+GLuint _glGetListBase() {
+    return LIST_BASE;
+}
+
+static DisplayList* _glGetDisplayList(GLuint list) {
+    if(!list || list >= MAX_DISPLAY_LIST_COUNT || !named_array_used(&DISPLAY_LISTS, list)) {
+        return NULL;
+    }
+
+    return (DisplayList*) named_array_get(&DISPLAY_LISTS, list);
+}
+
+static DisplayListChunk* _glAppendChunk(DisplayList* list, GLuint count) {
+    DisplayListChunk* chunks = (DisplayListChunk*) realloc(
+        list->chunks, sizeof(DisplayListChunk) * (list->chunk_count + 1)
+    );
+
+    if(!chunks) {
+        return NULL;
+    }
+
+    list->chunks = chunks;
+
+    DisplayListChunk* chunk = &chunks[list->chunk_count];
+    memset(chunk, 0, sizeof(DisplayListChunk));
+
+    chunk->count = count;
+    chunk->vertices = (Vertex*) malloc(sizeof(Vertex) * count);
+    chunk->extras = (VertexExtra*) malloc(sizeof(VertexExtra) * count);
+
+    if(!chunk->vertices || !chunk->extras) {
+        free(chunk->vertices);
+        free(chunk->extras);
+        return NULL;
+    }
+
+    ++list->chunk_count;
+    return chunk;
+}
+
+static void _glFreeChunks(DisplayList* list) {
+    for(GLuint i = 0; i < list->chunk_count; ++i) {
+        DisplayListChunk* chunk = &list->chunks[i];
+        free(chunk->vertices);
+        free(chunk->extras);
+        free(chunk->strip_vertices);
+        free(chunk->strip_extras);
+        free(chunk->output);
+        free(chunk->output_extras);
+    }
+
+    free(list->chunks);
+    list->chunks = NULL;
+    list->chunk_count = 0;
+}
+
+void _glRecordListChunk(const Vertex* vertices, const VertexExtra* extras, GLuint count, GLuint attributes,
+        GLenum mode, GLboolean stripify) {
+    DisplayListChunk* chunk = _glAppendChunk(&COMPILING_LIST, count);
+    if(!chunk) {
+        _glKosThrowError(GL_OUT_OF_MEMORY, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    chunk->attributes = attributes;
+    chunk->mode = mode;
+    chunk->stripify = stripify;
+    memcpy(chunk->vertices, vertices, sizeof(Vertex) * count);
+    memcpy(chunk->extras, extras, sizeof(VertexExtra) * count);
+}
+
+GLuint APIENTRY glGenLists(GLsizei range) {
+    TRACE();
+
+    /* Find the first run of range unused names */
+    GLuint first = 1;
+    GLsizei found = 0;
+
+    for(GLuint id = 1; id < MAX_DISPLAY_LIST_COUNT && found < range; ++id) {
+        if(named_array_used(&DISPLAY_LISTS, id)) {
+            first = id + 1;
+            found = 0;
+        } else {
+            ++found;
+        }
+    }
+
+    if(!range || found < range) {
+        return 0;
+    }
+
+    for(GLuint id = first; id < first + range; ++id) {
+        named_array_reserve(&DISPLAY_LISTS, id);
+    }
+
+    return first;
+}
+
+void APIENTRY glDeleteLists(GLuint list, GLsizei range) {
+    TRACE();
+
+    for(GLuint id = list; id < list + range; ++id) {
+        DisplayList* dl = _glGetDisplayList(id);
+        if(dl) {
+            _glFreeChunks(dl);
+            named_array_release(&DISPLAY_LISTS, id);
+        }
+    }
+}
+
+GLboolean APIENTRY glIsList(GLuint list) {
+    return _glGetDisplayList(list) != NULL;
+}
+
+void APIENTRY glNewList(GLuint list, GLenum mode) {
+    TRACE();
+
+    if(_glCheckImmediateModeInactive(__func__)) {
+        return;
+    }
+
+    if(!list || list >= MAX_DISPLAY_LIST_COUNT) {
+        _glKosThrowError(GL_INVALID_VALUE, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    if(mode != GL_COMPILE && mode != GL_COMPILE_AND_EXECUTE) {
+        _glKosThrowError(GL_INVALID_ENUM, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    if(LIST_MODE) {
+        _glKosThrowError(GL_INVALID_OPERATION, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    LIST_INDEX = list;
+    LIST_MODE = mode;
+}
+
+void APIENTRY glEndList() {
+    TRACE();
+
+    if(_glCheckImmediateModeInactive(__func__)) {
+        return;
+    }
+
+    if(!LIST_MODE) {
+        _glKosThrowError(GL_INVALID_OPERATION, __func__);
+        _glKosPrintError();
+        return;
+    }
+
+    /* Names which were never generated are created here */
+    DisplayList* dl = (DisplayList*) named_array_reserve(&DISPLAY_LISTS, LIST_INDEX);
+    _glFreeChunks(dl);
+
+    *dl = COMPILING_LIST;
+    COMPILING_LIST.chunks = NULL;
+    COMPILING_LIST.chunk_count = 0;
+
+    LIST_INDEX = 0;
+    LIST_MODE = 0;
+}
+
+void APIENTRY glCallList(GLuint list) {
+    TRACE();
+
+    if(_glCheckImmediateModeInactive(__func__)) {
+        return;
+    }
+
+    DisplayList* dl = _glGetDisplayList(list);
+    if(!dl) {
+        return;
+    }
+
+    for(GLuint i = 0; i < dl->chunk_count; ++i) {
+        DisplayListChunk* chunk = &dl->chunks[i];
+
+        /* Calls made while compiling copy the called list in */
+        if(LIST_MODE) {
+            _glRecordListChunk(
+                chunk->vertices, chunk->extras, chunk->count, chunk->attributes, chunk->mode, chunk->stripify
+            );
+        }
+
+        if(LIST_MODE != GL_COMPILE) {
+            _glSubmitDisplayListChunk(chunk);
+        }
+    }
+}
+
+void APIENTRY glCallLists(GLsizei n, GLenum type, const GLvoid* lists) {
+    TRACE();
+
+    if(_glCheckImmediateModeInactive(__func__)) {
+        return;
+    }
+
+    for(GLsizei i = 0; i < n; ++i) {
+        GLuint list;
+
+        switch(type) {
+            case GL_BYTE:
+                list = ((const GLbyte*) lists)[i];
+            break;
+            case GL_UNSIGNED_BYTE:
+                list = ((const GLubyte*) lists)[i];
+            break;
+            case GL_SHORT:
+                list = ((const GLshort*) lists)[i];
+            break;
+            case GL_UNSIGNED_SHORT:
+                list = ((const GLushort*) lists)[i];
+            break;
+            case GL_INT:
+                list = ((const GLint*) lists)[i];
+            break;
+            case GL_UNSIGNED_INT:
+                list = ((const GLuint*) lists)[i];
+            break;
+            case GL_FLOAT:
+                list = (GLuint) ((const GLfloat*) lists)[i];
+            break;
+            default:
+                _glKosThrowError(GL_INVALID_ENUM, __func__);
+                _glKosPrintError();
+                return;
+        }
+
+        glCallList(LIST_BASE + list);
+    }
+}
+
+void APIENTRY glListBase(GLuint base) {
+    LIST_BASE = base;
+}
@@ -14,7 +14,17 @@ GLfloat DEPTH_RANGE_MULTIPLIER_L = (1 - 0) / 2;
 GLfloat DEPTH_RANGE_MULTIPLIER_H = (0 + 1) / 2;
 
 static Stack MATRIX_STACKS[3]; // modelview, projection, texture
+
+/* Bumped whenever the top of a stack changes, so matrices derived from
+ * them only need recalculating when one they're built from has moved on */
+static GLuint MATRIX_VERSIONS[3] = {1, 1, 1};
+
 static Matrix4x4 NORMAL_MATRIX __attribute__((aligned(32)));
+static GLuint NORMAL_MATRIX_VERSION = 0;
+static GLboolean NORMAL_MATRIX_KEEPS_LENGTH = GL_TRUE;
+
+static Matrix4x4 MVP_MATRIX __attribute__((aligned(32)));
+static GLuint MVP_MATRIX_VERSIONS[2] = {0, 0}; // modelview, projection
 
 Viewport VIEWPORT = {
     0, 0, 640, 480, 320.0f, 240.0f, 320.0f, 240.0f
@@ -40,6 +50,14 @@ Matrix4x4* _glGetModelViewMatrix() {
     return (Matrix4x4*) stack_top(&MATRIX_STACKS[0]);
 }
 
+GLuint _glMatrixVersion(GLenum mode) {
+    return MATRIX_VERSIONS[mode & 0xF];
+}
+
+GL_FORCE_INLINE void stackChanged(GLubyte idx) {
+    ++MATRIX_VERSIONS[idx];
+}
+
 void _glInitMatrices() {
     init_stack(&MATRIX_STACKS[0], sizeof(Matrix4x4), 32);
     init_stack(&MATRIX_STACKS[1], sizeof(Matrix4x4), 32);
@@ -49,7 +67,9 @@ void _glInitMatrices() {
     stack_push(&MATRIX_STACKS[1], IDENTITY);
     stack_push(&MATRIX_STACKS[2], IDENTITY);
 
-    MEMCPY4(NORMAL_MATRIX, IDENTITY, sizeof(Matrix4x4));
+    stackChanged(0);
+    stackChanged(1);
+    stackChanged(2);
 
     const VideoMode* vid_mode = GetVideoMode();
 
@@ -57,47 +77,98 @@ void _glInitMatrices() {
     glViewport(0, 0, vid_mode->width, vid_mode->height);
 }
 
-#define swap(a, b) { \
-    GLfloat x = (a); \
-    a = b; \
-    b = x; \
+GL_FORCE_INLINE void cross3(const GLfloat* a, const GLfloat* b, GLfloat* out) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
 }
 
-static void inverse(GLfloat* m) {
-    GLfloat f4 = m[4];
-    GLfloat f8 = m[8];
-    GLfloat f1 = m[1];
-    GLfloat f9 = m[9];
-    GLfloat f2 = m[2];
-    GLfloat f6 = m[6];
-    GLfloat f12 = m[12];
-    GLfloat f13 = m[13];
-    GLfloat f14 = m[14];
-
-    m[1]  =  f4;
-    m[2]  =  f8;
-    m[4]  =  f1;
-    m[6]  =  f9;
-    m[8]  =  f2;
-    m[9]  =  f6;
-    m[12] = -(f12 * m[0]  +  f13 * m[4]  +  f14 * m[8]);
-    m[13] = -(f12 * m[1]  +  f13 * m[5]  +  f14 * m[9]);
-    m[14] = -(f12 * m[2]  +  f13 * m[6]  +  f14 * m[10]);
-}
+#define NORMAL_MATRIX_EPSILON 1e-3f
 
-static void transpose(GLfloat* m) {
-    swap(m[1], m[4]);
-    swap(m[2], m[8]);
-    swap(m[3], m[12]);
-    swap(m[6], m[9]);
-    swap(m[7], m[3]);
-    swap(m[11], m[14]);
+GL_FORCE_INLINE GLboolean nearlyEqual(GLfloat a, GLfloat b, GLfloat scale) {
+    return fabsf(a - b) <= NORMAL_MATRIX_EPSILON * scale;
 }
 
+/*
+ * The normal matrix is the inverse-transpose of the upper 3x3 of the
+ * modelview. It's only rebuilt when a lit draw loads it after the
+ * modelview has changed.
+ *
+ * Most modelviews are rotations and translations with at most a uniform
+ * scale, for those the inverse-transpose is the matrix itself divided by
+ * the scale squared. Dividing by the scale only instead keeps unit
+ * normals unit length, so they don't need renormalising per vertex. Any
+ * other matrix takes the general inverse-transpose, whose columns are
+ * the cross products of the modelview's columns over its determinant.
+ */
 static void recalculateNormalMatrix() {
-    MEMCPY4(NORMAL_MATRIX, stack_top(MATRIX_STACKS + (GL_MODELVIEW & 0xF)), sizeof(Matrix4x4));
-    inverse((GLfloat*) NORMAL_MATRIX);
-    transpose((GLfloat*) NORMAL_MATRIX);
+    if(NORMAL_MATRIX_VERSION == MATRIX_VERSIONS[GL_MODELVIEW & 0xF]) {
+        return;
+    }
+
+    NORMAL_MATRIX_VERSION = MATRIX_VERSIONS[GL_MODELVIEW & 0xF];
+
+    const GLfloat* m = (const GLfloat*) stack_top(MATRIX_STACKS + (GL_MODELVIEW & 0xF));
+    GLfloat* n = (GLfloat*) NORMAL_MATRIX;
+
+    const GLfloat* c0 = m;
+    const GLfloat* c1 = m + 4;
+    const GLfloat* c2 = m + 8;
+
+    const GLfloat l0 = c0[0] * c0[0] + c0[1] * c0[1] + c0[2] * c0[2];
+    const GLfloat l1 = c1[0] * c1[0] + c1[1] * c1[1] + c1[2] * c1[2];
+    const GLfloat l2 = c2[0] * c2[0] + c2[1] * c2[1] + c2[2] * c2[2];
+
+    const GLfloat d01 = c0[0] * c1[0] + c0[1] * c1[1] + c0[2] * c1[2];
+    const GLfloat d02 = c0[0] * c2[0] + c0[1] * c2[1] + c0[2] * c2[2];
+    const GLfloat d12 = c1[0] * c2[0] + c1[1] * c2[1] + c1[2] * c2[2];
+
+    MEMSET(NORMAL_MATRIX, 0, sizeof(Matrix4x4));
+    n[M15] = 1.0f;
+
+    NORMAL_MATRIX_KEEPS_LENGTH = l0 > 0.0f &&
+        nearlyEqual(l0, l1, l0) && nearlyEqual(l0, l2, l0) &&
+        nearlyEqual(d01, 0.0f, l0) && nearlyEqual(d02, 0.0f, l0) && nearlyEqual(d12, 0.0f, l0);
+
+    if(NORMAL_MATRIX_KEEPS_LENGTH) {
+        const GLfloat s = (nearlyEqual(l0, 1.0f, 1.0f)) ? 1.0f : MATH_fsrra(l0);
+
+        GLubyte i;
+        for(i = 0; i < 3; ++i) {
+            n[i] = c0[i] * s;
+            n[i + 4] = c1[i] * s;
+            n[i + 8] = c2[i] * s;
+        }
+
+        return;
+    }
+
+    cross3(c1, c2, n);
+    cross3(c2, c0, n + 4);
+    cross3(c0, c1, n + 8);
+
+    const GLfloat det = c0[0] * n[0] + c0[1] * n[1] + c0[2] * n[2];
+
+    if(det == 0.0f) {
+        /* Singular, nothing sensible to invert so use the matrix as is */
+        GLubyte i;
+        for(i = 0; i < 3; ++i) {
+            n[i] = c0[i];
+            n[i + 4] = c1[i];
+            n[i + 8] = c2[i];
+        }
+
+        return;
+    }
+
+    const GLfloat invDet = 1.0f / det;
+
+    GLubyte i;
+    for(i = 0; i < 3; ++i) {
+        n[i] *= invDet;
+        n[i + 4] *= invDet;
+        n[i + 8] *= invDet;
+    }
 }
 
 void APIENTRY glMatrixMode(GLenum mode) {
@@ -111,13 +182,12 @@ void APIENTRY glPushMatrix() {
 
 void APIENTRY glPopMatrix() {
     stack_pop(MATRIX_STACKS + MATRIX_IDX);
-    if(MATRIX_MODE == GL_MODELVIEW) {
-        recalculateNormalMatrix();
-    }
+    stackChanged(MATRIX_IDX);
 }
 
 void APIENTRY glLoadIdentity() {
     stack_replace(MATRIX_STACKS + MATRIX_IDX, IDENTITY);
+    stackChanged(MATRIX_IDX);
 }
 
 void APIENTRY glTranslatef(GLfloat x, GLfloat y, GLfloat z) {
@@ -132,9 +202,7 @@ void APIENTRY glTranslatef(GLfloat x, GLfloat y, GLfloat z) {
     MultiplyMatrix4x4(&trn);
     DownloadMatrix4x4(stack_top(MATRIX_STACKS + MATRIX_IDX));
 
-    if(MATRIX_MODE == GL_MODELVIEW) {
-        recalculateNormalMatrix();
-    }
+    stackChanged(MATRIX_IDX);
 }
 
 
@@ -150,9 +218,7 @@ void APIENTRY glScalef(GLfloat x, GLfloat y, GLfloat z) {
     MultiplyMatrix4x4(&scale);
     DownloadMatrix4x4(stack_top(MATRIX_STACKS + MATRIX_IDX));
 
-    if(MATRIX_MODE == GL_MODELVIEW) {
-        recalculateNormalMatrix();
-    }
+    stackChanged(MATRIX_IDX);
 }
 
 void APIENTRY glRotatef(GLfloat angle, GLfloat x, GLfloat  y, GLfloat z) {
@@ -193,9 +259,7 @@ void APIENTRY glRotatef(GLfloat angle, GLfloat x, GLfloat  y, GLfloat z) {
     MultiplyMatrix4x4((const Matrix4x4*) &rotate);
     DownloadMatrix4x4(stack_top(MATRIX_STACKS + MATRIX_IDX));
 
-    if(MATRIX_MODE == GL_MODELVIEW) {
-        recalculateNormalMatrix();
-    }
+    stackChanged(MATRIX_IDX);
 }
 
 /* Load an arbitrary matrix */
@@ -224,9 +288,7 @@ void APIENTRY glLoadMatrixf(const GLfloat *m) {
 
     stack_replace(MATRIX_STACKS + MATRIX_IDX, TEMP);
 
-    if(MATRIX_MODE == GL_MODELVIEW) {
-        recalculateNormalMatrix();
-    }
+    stackChanged(MATRIX_IDX);
 }
 
 /* Ortho */
@@ -252,6 +314,7 @@ void APIENTRY glOrtho(GLfloat left, GLfloat right,
     UploadMatrix4x4(stack_top(MATRIX_STACKS + MATRIX_IDX));
     MultiplyMatrix4x4((const Matrix4x4*) &OrthoMatrix);
     DownloadMatrix4x4(stack_top(MATRIX_STACKS + MATRIX_IDX));
+    stackChanged(MATRIX_IDX);
 }
 
 
@@ -283,6 +346,7 @@ void APIENTRY glFrustum(GLfloat left, GLfloat right,
     UploadMatrix4x4(stack_top(MATRIX_STACKS + MATRIX_IDX));
     MultiplyMatrix4x4((const Matrix4x4*) &FrustumMatrix);
     DownloadMatrix4x4(stack_top(MATRIX_STACKS + MATRIX_IDX));
+    stackChanged(MATRIX_IDX);
 }
 
 
@@ -295,9 +359,7 @@ void glMultMatrixf(const GLfloat *m) {
     MultiplyMatrix4x4((const Matrix4x4*) &TEMP);
     DownloadMatrix4x4(stack_top(MATRIX_STACKS + MATRIX_IDX));
 
-    if(MATRIX_MODE == GL_MODELVIEW) {
-        recalculateNormalMatrix();
-    }
+    stackChanged(MATRIX_IDX);
 }
 
 /* Load an arbitrary transposed matrix */
@@ -329,9 +391,7 @@ void glLoadTransposeMatrixf(const GLfloat *m) {
 
     stack_replace(MATRIX_STACKS + MATRIX_IDX, TEMP);
 
-    if(MATRIX_MODE == GL_MODELVIEW) {
-        recalculateNormalMatrix();
-    }
+    stackChanged(MATRIX_IDX);
 }
 
 /* Multiply the current matrix by an arbitrary transposed matrix */
@@ -362,9 +422,7 @@ void glMultTransposeMatrixf(const GLfloat *m) {
     MultiplyMatrix4x4((const Matrix4x4*) &TEMP);
     DownloadMatrix4x4(stack_top(MATRIX_STACKS + MATRIX_IDX));
 
-    if(MATRIX_MODE == GL_MODELVIEW) {
-        recalculateNormalMatrix();
-    }
+    stackChanged(MATRIX_IDX);
 }
 
 /* Set the GL viewport */
@@ -457,6 +515,7 @@ void gluLookAt(GLfloat eyex, GLfloat eyey, GLfloat eyez, GLfloat centerx,
     MultiplyMatrix4x4((const Matrix4x4*) &trn);
     MultiplyMatrix4x4(stack_top(MATRIX_STACKS + (GL_MODELVIEW & 0xF)));
     DownloadMatrix4x4(stack_top(MATRIX_STACKS + (GL_MODELVIEW & 0xF)));
+    stackChanged(GL_MODELVIEW & 0xF);
 }
 
 void _glMatrixLoadTexture() {
@@ -471,11 +530,38 @@ void _glMatrixLoadProjection() {
     UploadMatrix4x4((const Matrix4x4*) stack_top(MATRIX_STACKS + (GL_PROJECTION & 0xF)));
 }
 
+/* The product is only worked out again once either stack has changed,
+ * draws under the same camera and transform reuse it */
+const Matrix4x4* _glGetModelViewProjectionMatrix() {
+    const GLuint modelview = MATRIX_VERSIONS[GL_MODELVIEW & 0xF];
+    const GLuint projection = MATRIX_VERSIONS[GL_PROJECTION & 0xF];
+
+    if(MVP_MATRIX_VERSIONS[0] != modelview || MVP_MATRIX_VERSIONS[1] != projection) {
+        UploadMatrix4x4((const Matrix4x4*) stack_top(MATRIX_STACKS + (GL_PROJECTION & 0xF)));
+        MultiplyMatrix4x4((const Matrix4x4*) stack_top(MATRIX_STACKS + (GL_MODELVIEW & 0xF)));
+        DownloadMatrix4x4(&MVP_MATRIX);
+
+        MVP_MATRIX_VERSIONS[0] = modelview;
+        MVP_MATRIX_VERSIONS[1] = projection;
+    }
+
+    return (const Matrix4x4*) &MVP_MATRIX;
+}
+
 void _glMatrixLoadModelViewProjection() {
-    UploadMatrix4x4((const Matrix4x4*) stack_top(MATRIX_STACKS + (GL_PROJECTION & 0xF)));
-    MultiplyMatrix4x4((const Matrix4x4*) stack_top(MATRIX_STACKS + (GL_MODELVIEW & 0xF)));
+    UploadMatrix4x4(_glGetModelViewProjectionMatrix());
+}
+
+void _glMatrixLoadIdentity() {
+    UploadMatrix4x4(&IDENTITY);
 }
 
 void _glMatrixLoadNormal() {
+    recalculateNormalMatrix();
     UploadMatrix4x4((const Matrix4x4*) &NORMAL_MATRIX);
 }
+
+GLboolean _glNormalMatrixKeepsLength() {
+    recalculateNormalMatrix();
+    return NORMAL_MATRIX_KEEPS_LENGTH;
+}
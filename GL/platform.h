@@ -166,6 +166,15 @@ typedef struct VideoMode {
 
 const VideoMode* GetVideoMode();
 
+/* Rasterizer counters for the last frame. Backends which can't provide
+ * them (the PVR does its own hidden surface removal) report zeros. */
+typedef struct GPUStats {
+    uint32_t hiz_triangles_tested;
+    uint32_t hiz_triangles_rejected;
+    uint32_t hiz_blocks_tested;
+    uint32_t hiz_blocks_rejected;
+} GPUStats;
+
 /* Duplication of pvr_poly_cxt_t from KOS so that we can
  * compile on non-KOS platforms for testing */
 
@@ -8,7 +8,9 @@
 
 #define PVR_VERTEX_BUF_SIZE 2560 * 256
 
-void InitGPU(_Bool autosort, _Bool fsaa) {
+void InitGPU(_Bool autosort, _Bool fsaa, _Bool headless) {
+    (void) headless;
+
     pvr_init_params_t params = {
         /* Enable opaque and translucent polygons with size 32 and 32 */
         {PVR_BINSIZE_32, PVR_BINSIZE_0, PVR_BINSIZE_32, PVR_BINSIZE_0, PVR_BINSIZE_32},
@@ -116,7 +116,16 @@ static inline void TransformVertices(Vertex* vertices, const int count) {
     }
 }
 
-void InitGPU(_Bool autosort, _Bool fsaa);
+void InitGPU(_Bool autosort, _Bool fsaa, _Bool headless);
+
+/* The PVR framebuffer isn't readable as ARGB8888 */
+static inline const uint32_t* GPUFramebuffer() {
+    return NULL;
+}
+
+static inline void GPUGetStats(GPUStats* stats) {
+    memset(stats, 0, sizeof(GPUStats));
+}
 
 static inline size_t GPUMemoryAvailable() {
     return pvr_mem_available();
@@ -1,22 +1,65 @@
 #include <SDL.h>
 
+#include <math.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "../platform.h"
+#include "../../containers/aligned_vector.h"
 #include "software.h"
 #include "software/edge_equation.h"
 #include "software/parameter_equation.h"
+#include "software/sampler.h"
+
+/* Same tile size as the PVR (and _glApplyScissor) */
+#define TILE_SIZE 32
+
+/* Tiles are rasterized in blocks of this many pixels square, so
+ * that blocks outside (or fully inside) a triangle are found cheaply */
+#define BLOCK_SIZE 8
+#define MAX_WORKER_THREADS 16
+
+/* Slack allowed between the depth planes used for hierarchical Z and
+ * the per-pixel values, which are stepped incrementally */
+#define HIZ_EPSILON 1e-4f
+
+#define VRAM_SIZE (16 * 1024 * 1024)
 
-static size_t AVAILABLE_VRAM = 16 * 1024 * 1024;
+/* Aligned to its size, so that the texture addresses packed into
+ * mode3 are offsets from VRAM */
+static uint8_t* VRAM = NULL;
+static size_t AVAILABLE_VRAM = VRAM_SIZE;
 static Matrix4x4 MATRIX;
 
 static SDL_Window* WINDOW = NULL;
 static SDL_Renderer* RENDERER = NULL;
+static SDL_Texture* FRAMEBUFFER_TEXTURE = NULL;
+
+/* When headless, SDL is never initialized and frames only
+ * exist in COLOR_BUFFER */
+static _Bool HEADLESS = 0;
+
+/* Sort the TR list per tile, like the PVR */
+static _Bool AUTOSORT = 0;
 
 static uint8_t BACKGROUND_COLOR[3] = {0, 0, 0};
+static float CLEAR_DEPTH = 0.0f;
+
+/* Punch-through fragments with alpha at or below this are discarded */
+static uint8_t ALPHA_CUTOFF = 0;
 
 GPUCulling CULL_MODE = GPU_CULLING_CCW;
+static GPUList CURRENT_LIST = GPU_LIST_OP_POLY;
 
 
 static VideoMode vid_mode = {
@@ -32,35 +75,125 @@ typedef struct GPUVertex {
     float u;
     float v;
     uint8_t bgra[4];
-    uint8_t obgra[4];
+
+    /* GLdc keeps clip space W here rather than the offset colour */
+    float w;
 } GPUVertex;
 
-#define MIN(x, y) ((x) < (y) ? (x) : (y))
-#define MAX(x, y) ((x) > (y) ? (x) : (y))
+/* Everything the rasterizer needs from a polygon header */
+typedef struct PolyState {
+    GPUDepthCompare depth_func;
+    GPUDepthWrite depth_write;
 
-static void DrawTriangle(GPUVertex* v0, GPUVertex* v1, GPUVertex* v2) {
-    // Compute triangle bounding box.
+    bool vertex_alpha;
 
-    int minX = MIN(MIN(v0->x, v1->x), v2->x);
-    int maxX = MAX(MAX(v0->x, v1->x), v2->x);
-    int minY = MIN(MIN(v0->y, v1->y), v2->y);
-    int maxY = MAX(MAX(v0->y, v1->y), v2->y);
+    /* Only punch-through polys are alpha tested */
+    bool alpha_test;
 
-    // Clip to scissor rect.
+    /* ONE/ZERO blending is a plain write, and skips reading the framebuffer */
+    bool blend;
+    GPUBlend src_blend;
+    GPUBlend dst_blend;
 
-    minX = MAX(minX, 0);
-    maxX = MIN(maxX, vid_mode.width);
-    minY = MAX(minY, 0);
-    maxY = MIN(maxY, vid_mode.height);
+    bool textured;
+    bool texture_alpha;
+    GPUTextureEnv env;
+    Sampler sampler;
+} PolyState;
 
-    // Compute edge equations.
+/* A triangle which has been set up and binned, ready for
+ * the tile workers to rasterize */
+typedef struct Triangle {
+    EdgeEquation e0, e1, e2;
+    ParameterEquation z;
+    ParameterEquation r, g, b, a;
+
+    /* Perspective correct texture coordinates (divided by W) */
+    ParameterEquation invw, u, v;
+
+    /* Depth range of the vertices, bounds the plane in z */
+    float z_min, z_max;
+
+    uint32_t state;
+
+    int min_x, min_y;
+    int max_x, max_y;
+} Triangle;
+
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define CLAMP(x, l, h) (((x) > (h)) ? (h) : (((x) < (l)) ? (l) : (x)))
+
+/* ARGB8888, presented once per frame */
+static uint32_t* COLOR_BUFFER = NULL;
+
+/* Z as written by glPerspectiveDivide, so larger values are nearer */
+static float* DEPTH_BUFFER = NULL;
+
+static int TILES_X = 0;
+static int TILES_Y = 0;
+static int TILE_COUNT = 0;
+
+/* Hierarchical Z. A lower bound on the depth stored in each block (the
+ * furthest value), and the lowest of those for each tile. Triangles and
+ * blocks entirely further away than this fail a GREATER/GEQUAL compare
+ * and are skipped before any edge or attribute work. */
+static int BLOCKS_X = 0;
+static float* HIZ_BLOCKS = NULL;
+static float* HIZ_TILES = NULL;
+
+/* Counted per tile so workers never share them, summed per list */
+static GPUStats* TILE_STATS = NULL;
+static GPUStats STATS;
+
+/* Triangles for the list currently being submitted, and per-tile
+ * bins of indexes into it (kept in submission order) */
+static AlignedVector STATES;
+static AlignedVector TRIANGLES;
+static AlignedVector* TILE_BINS = NULL;
+
+/* Per-tile scratch space for sorting TR bins back to front */
+typedef struct SortEntry {
+    float depth;
+    uint32_t index;
+} SortEntry;
+
+static AlignedVector* TILE_SORT = NULL;
+
+static pthread_t WORKERS[MAX_WORKER_THREADS];
+static int WORKER_COUNT = 0;
+
+static pthread_mutex_t WORK_MUTEX = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t WORK_READY = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t WORK_DONE = PTHREAD_COND_INITIALIZER;
+static uint32_t WORK_GENERATION = 0;
+static int WORKERS_BUSY = 0;
+static int NEXT_TILE = 0;
+
+/* Snaps a screen space coordinate to the fixed point grid */
+static inline int32_t SnapCoordinate(float v) {
+    return (int32_t) lrintf(v * SUBPIXEL_ONE);
+}
+
+static void SetupTriangle(GPUVertex* v0, GPUVertex* v1, GPUVertex* v2) {
+    if(!STATES.size) {
+        return;
+    }
+
+    int32_t p0[2] = {SnapCoordinate(v0->x), SnapCoordinate(v0->y)};
+    int32_t p1[2] = {SnapCoordinate(v1->x), SnapCoordinate(v1->y)};
+    int32_t p2[2] = {SnapCoordinate(v2->x), SnapCoordinate(v2->y)};
+
+    // Compute edge equations. Each edge is opposite the vertex
+    // with the same index, so they double as barycentric weights.
 
     EdgeEquation e0, e1, e2;
-    EdgeEquationInit(&e0, &v0->x, &v1->x);
-    EdgeEquationInit(&e1, &v1->x, &v2->x);
-    EdgeEquationInit(&e2, &v2->x, &v0->x);
+    EdgeEquationInit(&e0, p1, p2);
+    EdgeEquationInit(&e1, p2, p0);
+    EdgeEquationInit(&e2, p0, p1);
 
-    float area = 0.5 * (e0.c + e1.c + e2.c);
+    /* Twice the signed area, in fixed point units */
+    int64_t area = e0.c + e1.c + e2.c;
 
     /* This is very ugly. I don't understand the math properly
      * so I just swap the vertex order if something is back-facing
@@ -69,10 +202,13 @@ static void DrawTriangle(GPUVertex* v0, GPUVertex* v1, GPUVertex* v2) {
     GPUVertex* tv = v0; \
     v0 = v1; \
     v1 = tv; \
-    EdgeEquationInit(&e0, &v0->x, &v1->x); \
-    EdgeEquationInit(&e1, &v1->x, &v2->x); \
-    EdgeEquationInit(&e2, &v2->x, &v0->x); \
-    area = 0.5f * (e0.c + e1.c + e2.c) \
+    int32_t tp[2] = {p0[0], p0[1]}; \
+    p0[0] = p1[0]; p0[1] = p1[1]; \
+    p1[0] = tp[0]; p1[1] = tp[1]; \
+    EdgeEquationInit(&e0, p1, p2); \
+    EdgeEquationInit(&e1, p2, p0); \
+    EdgeEquationInit(&e2, p0, p1); \
+    area = e0.c + e1.c + e2.c \
 
     // Check if triangle is backfacing.
     if(CULL_MODE == GPU_CULLING_CCW) {
@@ -93,28 +229,810 @@ static void DrawTriangle(GPUVertex* v0, GPUVertex* v1, GPUVertex* v2) {
         REVERSE_WINDING();
     }
 
-    ParameterEquation r, g, b;
+#undef REVERSE_WINDING
+
+    if(area == 0) {
+        return;
+    }
+
+    // Compute the range of pixels whose centres lie within the
+    // triangle's bounding box, clipped to the screen.
+
+    const int32_t half = SUBPIXEL_ONE / 2;
+
+    int minX = (MIN(MIN(p0[0], p1[0]), p2[0]) - half + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS;
+    int maxX = ((MAX(MAX(p0[0], p1[0]), p2[0]) - half) >> SUBPIXEL_BITS) + 1;
+    int minY = (MIN(MIN(p0[1], p1[1]), p2[1]) - half + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS;
+    int maxY = ((MAX(MAX(p0[1], p1[1]), p2[1]) - half) >> SUBPIXEL_BITS) + 1;
+
+    minX = MAX(minX, 0);
+    maxX = MIN(maxX, vid_mode.width);
+    minY = MAX(minY, 0);
+    maxY = MIN(maxY, vid_mode.height);
+
+    if(minX >= maxX || minY >= maxY) {
+        return;
+    }
+
+    Triangle* tri = (Triangle*) aligned_vector_extend(&TRIANGLES, 1);
+    uint32_t idx = TRIANGLES.size - 1;
+
+    tri->e0 = e0;
+    tri->e1 = e1;
+    tri->e2 = e2;
+
+    const float half_area = 0.5f * (float) area;
+
+    ParameterEquationInit(&tri->z, v0->z, v1->z, v2->z, &e0, &e1, &e2, half_area);
+    ParameterEquationInit(&tri->r, v0->bgra[2], v1->bgra[2], v2->bgra[2], &e0, &e1, &e2, half_area);
+    ParameterEquationInit(&tri->g, v0->bgra[1], v1->bgra[1], v2->bgra[1], &e0, &e1, &e2, half_area);
+    ParameterEquationInit(&tri->b, v0->bgra[0], v1->bgra[0], v2->bgra[0], &e0, &e1, &e2, half_area);
+    ParameterEquationInit(&tri->a, v0->bgra[3], v1->bgra[3], v2->bgra[3], &e0, &e1, &e2, half_area);
+
+    tri->z_min = MIN(MIN(v0->z, v1->z), v2->z);
+    tri->z_max = MAX(MAX(v0->z, v1->z), v2->z);
+
+    tri->state = STATES.size - 1;
+
+    const PolyState* state = (const PolyState*) aligned_vector_back(&STATES);
+    if(state->textured) {
+        const float w0 = 1.0f / v0->w, w1 = 1.0f / v1->w, w2 = 1.0f / v2->w;
+
+        ParameterEquationInit(&tri->invw, w0, w1, w2, &e0, &e1, &e2, half_area);
+        ParameterEquationInit(&tri->u, v0->u * w0, v1->u * w1, v2->u * w2, &e0, &e1, &e2, half_area);
+        ParameterEquationInit(&tri->v, v0->v * w0, v1->v * w1, v2->v * w2, &e0, &e1, &e2, half_area);
+    } else {
+        /* Never sampled, but keep the stepped values well defined */
+        memset(&tri->invw, 0, sizeof(ParameterEquation));
+        memset(&tri->u, 0, sizeof(ParameterEquation));
+        memset(&tri->v, 0, sizeof(ParameterEquation));
+    }
+
+    tri->min_x = minX;
+    tri->max_x = maxX;
+    tri->min_y = minY;
+    tri->max_y = maxY;
+
+    // Bin the triangle into every tile its bounding box touches, skipping
+    // tiles which lie entirely outside one of the edges.
+
+    const EdgeEquation* edges[3] = {&tri->e0, &tri->e1, &tri->e2};
+
+    for(int ty = minY / TILE_SIZE; ty <= (maxY - 1) / TILE_SIZE; ++ty) {
+        for(int tx = minX / TILE_SIZE; tx <= (maxX - 1) / TILE_SIZE; ++tx) {
+            int x0 = tx * TILE_SIZE, y0 = ty * TILE_SIZE;
+            int x1 = x0 + TILE_SIZE - 1, y1 = y0 + TILE_SIZE - 1;
+
+            bool outside = false;
+            for(int i = 0; i < 3 && !outside; ++i) {
+                /* Test the pixel furthest along the edge normal */
+                int x = (edges[i]->a > 0) ? x1 : x0;
+                int y = (edges[i]->b > 0) ? y1 : y0;
+                outside = EdgeEquationEvaluate(edges[i], x, y) + EdgeEquationBias(edges[i]) < 0;
+            }
+
+            if(!outside) {
+                aligned_vector_push_back(&TILE_BINS[ty * TILES_X + tx], &idx, 1);
+            }
+        }
+    }
+}
+
+/* Vertices may lie this many pixels outside the screen before the
+ * triangle is clipped, which keeps fixed point edge values in range */
+#define GUARD_BAND 4096
+
+/* Interpolates linearly in screen space. Texture coordinates are
+ * interpolated divided by W, so clipping doesn't change the mapping. */
+static void InterpolateVertex(GPUVertex* out, const GPUVertex* a, const GPUVertex* b, float t) {
+    const float aw = 1.0f / a->w, bw = 1.0f / b->w;
+    const float invw = aw + (bw - aw) * t;
+
+    out->flags = a->flags;
+    out->x = a->x + (b->x - a->x) * t;
+    out->y = a->y + (b->y - a->y) * t;
+    out->z = a->z + (b->z - a->z) * t;
+    out->w = 1.0f / invw;
+    out->u = (a->u * aw + (b->u * bw - a->u * aw) * t) * out->w;
+    out->v = (a->v * aw + (b->v * bw - a->v * aw) * t) * out->w;
+
+    for(int i = 0; i < 4; ++i) {
+        out->bgra[i] = a->bgra[i] + ((float) b->bgra[i] - a->bgra[i]) * t + 0.5f;
+    }
+}
+
+/* Clips a polygon against one side of the guard band, returns the
+ * new vertex count */
+static int ClipPolygon(const GPUVertex* in, int count, GPUVertex* out, int axis, float limit, float sign) {
+    int n = 0;
+
+    for(int i = 0; i < count; ++i) {
+        const GPUVertex* a = &in[i];
+        const GPUVertex* b = &in[(i + 1) % count];
+
+        const float da = sign * ((&a->x)[axis] - limit);
+        const float db = sign * ((&b->x)[axis] - limit);
+
+        if(da <= 0) {
+            out[n++] = *a;
+        }
+
+        if((da < 0 && db > 0) || (da > 0 && db < 0)) {
+            InterpolateVertex(&out[n++], a, b, da / (da - db));
+        }
+    }
+
+    return n;
+}
+
+static void SubmitTriangle(GPUVertex* v0, GPUVertex* v1, GPUVertex* v2) {
+    const float min_x = -GUARD_BAND, max_x = vid_mode.width + GUARD_BAND;
+    const float min_y = -GUARD_BAND, max_y = vid_mode.height + GUARD_BAND;
+
+    const GPUVertex* vertices[3] = {v0, v1, v2};
+
+    bool inside = true;
+    for(int i = 0; i < 3; ++i) {
+        const float x = vertices[i]->x, y = vertices[i]->y;
+
+        if(!isfinite(x) || !isfinite(y)) {
+            return;
+        }
+
+        if(x < min_x || x > max_x || y < min_y || y > max_y) {
+            inside = false;
+        }
+    }
+
+    if(inside) {
+        SetupTriangle(v0, v1, v2);
+        return;
+    }
+
+    /* Each of the four planes can add at most one vertex */
+    GPUVertex a[7], b[7];
+    a[0] = *v0;
+    a[1] = *v1;
+    a[2] = *v2;
+
+    int n = 3;
+    n = ClipPolygon(a, n, b, 0, min_x, -1.0f);
+    n = ClipPolygon(b, n, a, 0, max_x, 1.0f);
+    n = ClipPolygon(a, n, b, 1, min_y, -1.0f);
+    n = ClipPolygon(b, n, a, 1, max_y, 1.0f);
+
+    for(int i = 2; i < n; ++i) {
+        SetupTriangle(&a[0], &a[i - 1], &a[i]);
+    }
+}
+
+static inline bool DepthTest(GPUDepthCompare func, float z, float stored) {
+    /* The PVR passes when "incoming <func> stored" holds */
+    switch(func) {
+        case GPU_DEPTHCMP_NEVER: return false;
+        case GPU_DEPTHCMP_LESS: return z < stored;
+        case GPU_DEPTHCMP_EQUAL: return z == stored;
+        case GPU_DEPTHCMP_LEQUAL: return z <= stored;
+        case GPU_DEPTHCMP_GREATER: return z > stored;
+        case GPU_DEPTHCMP_NOTEQUAL: return z != stored;
+        case GPU_DEPTHCMP_GEQUAL: return z >= stored;
+        default:
+            return true;
+    }
+}
+
+/* Multiply two 0 - 255 values, rounding correctly */
+static inline uint32_t Mul8(uint32_t a, uint32_t b) {
+    uint32_t v = a * b + 128;
+    return (v + (v >> 8)) >> 8;
+}
+
+static inline uint32_t ApplyTextureEnv(GPUTextureEnv env, uint32_t texel, uint32_t color) {
+    const uint32_t ta = texel >> 24, tr = (texel >> 16) & 0xFF, tg = (texel >> 8) & 0xFF, tb = texel & 0xFF;
+    const uint32_t ca = color >> 24, cr = (color >> 16) & 0xFF, cg = (color >> 8) & 0xFF, cb = color & 0xFF;
+
+    uint32_t a, r, g, b;
+
+    switch(env) {
+        case GPU_TXRENV_REPLACE:
+            return texel;
+        case GPU_TXRENV_MODULATE:
+            a = ta;
+            r = Mul8(tr, cr);
+            g = Mul8(tg, cg);
+            b = Mul8(tb, cb);
+        break;
+        case GPU_TXRENV_DECAL:
+            a = ca;
+            r = Mul8(tr, ta) + Mul8(cr, 255 - ta);
+            g = Mul8(tg, ta) + Mul8(cg, 255 - ta);
+            b = Mul8(tb, ta) + Mul8(cb, 255 - ta);
+        break;
+        case GPU_TXRENV_MODULATEALPHA:
+        default:
+            a = Mul8(ta, ca);
+            r = Mul8(tr, cr);
+            g = Mul8(tg, cg);
+            b = Mul8(tb, cb);
+        break;
+    }
+
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+/* Blend factor applied to one channel. For the PVR DESTCOLOR means
+ * "the other colour", so it's the source colour when used as the
+ * destination factor. */
+static inline uint32_t BlendFactor(GPUBlend factor, uint32_t other, uint32_t src_alpha, uint32_t dst_alpha) {
+    switch(factor) {
+        case GPU_BLEND_ZERO: return 0;
+        case GPU_BLEND_ONE: return 255;
+        case GPU_BLEND_DESTCOLOR: return other;
+        case GPU_BLEND_INVDESTCOLOR: return 255 - other;
+        case GPU_BLEND_SRCALPHA: return src_alpha;
+        case GPU_BLEND_INVSRCALPHA: return 255 - src_alpha;
+        case GPU_BLEND_DESTALPHA: return dst_alpha;
+        case GPU_BLEND_INVDESTALPHA:
+        default:
+            return 255 - dst_alpha;
+    }
+}
+
+/* Returns true if the factor is known to be 0 (or 255) without
+ * looking at the destination */
+static inline bool BlendFactorIs(GPUBlend factor, uint32_t src_alpha, uint32_t value) {
+    switch(factor) {
+        case GPU_BLEND_ZERO: return value == 0;
+        case GPU_BLEND_ONE: return value == 255;
+        case GPU_BLEND_SRCALPHA: return src_alpha == value;
+        case GPU_BLEND_INVSRCALPHA: return 255 - src_alpha == value;
+        default:
+            return false;
+    }
+}
+
+static inline uint32_t Blend(GPUBlend src_blend, GPUBlend dst_blend, uint32_t src, uint32_t dst) {
+    const uint32_t sa = src >> 24;
+    const uint32_t da = dst >> 24;
+
+    uint32_t out = 0;
+    for(uint32_t shift = 0; shift < 32; shift += 8) {
+        const uint32_t s = (src >> shift) & 0xFF;
+        const uint32_t d = (dst >> shift) & 0xFF;
+
+        const uint32_t v = Mul8(s, BlendFactor(src_blend, d, sa, da)) +
+                           Mul8(d, BlendFactor(dst_blend, s, sa, da));
+
+        out |= MIN(v, 255u) << shift;
+    }
+
+    return out;
+}
+
+/* Attribute values at a pixel centre, stepped incrementally across a span */
+typedef struct Interpolants {
+    float z;
+    float r, g, b, a;
+    float invw, u, v;
+} Interpolants;
+
+static inline void InterpolantsInit(Interpolants* it, const Triangle* tri, bool textured, float x, float y) {
+    it->z = ParameterEquationEvaluate(&tri->z, x, y);
+    it->r = ParameterEquationEvaluate(&tri->r, x, y);
+    it->g = ParameterEquationEvaluate(&tri->g, x, y);
+    it->b = ParameterEquationEvaluate(&tri->b, x, y);
+    it->a = ParameterEquationEvaluate(&tri->a, x, y);
+
+    if(textured) {
+        it->invw = ParameterEquationEvaluate(&tri->invw, x, y);
+        it->u = ParameterEquationEvaluate(&tri->u, x, y);
+        it->v = ParameterEquationEvaluate(&tri->v, x, y);
+    } else {
+        it->invw = it->u = it->v = 0.0f;
+    }
+}
+
+static inline void InterpolantsStep(Interpolants* it, const Interpolants* dx) {
+    it->z += dx->z;
+    it->r += dx->r;
+    it->g += dx->g;
+    it->b += dx->b;
+    it->a += dx->a;
+    it->invw += dx->invw;
+    it->u += dx->u;
+    it->v += dx->v;
+}
+
+static inline void ShadeFragment(const PolyState* state, const Interpolants* it, uint32_t* dst, float* depth) {
+    /* Reject hidden pixels before doing any colour work */
+    if(!DepthTest(state->depth_func, it->z, *depth)) {
+        return;
+    }
+
+    int rint = it->r;
+    int gint = it->g;
+    int bint = it->b;
+    int aint = (state->vertex_alpha) ? it->a : 255;
+
+    rint = CLAMP(rint, 0, 255);
+    gint = CLAMP(gint, 0, 255);
+    bint = CLAMP(bint, 0, 255);
+    aint = CLAMP(aint, 0, 255);
+
+    uint32_t color = (aint << 24) | (rint << 16) | (gint << 8) | bint;
+
+    if(state->textured) {
+        const float w = 1.0f / it->invw;
+
+        uint32_t texel = SamplerSample(&state->sampler, it->u * w, it->v * w);
+        if(!state->texture_alpha) {
+            texel |= 0xFF000000;
+        }
+
+        color = ApplyTextureEnv(state->env, texel, color);
+    }
+
+    const uint32_t alpha = color >> 24;
+
+    /* Discarded punch-through fragments mustn't touch the depth buffer */
+    if(state->alpha_test && alpha <= ALPHA_CUTOFF) {
+        return;
+    }
+
+    if(state->depth_write == GPU_DEPTHWRITE_ENABLE) {
+        *depth = it->z;
+    }
+
+    if(!state->blend) {
+        *dst = color;
+        return;
+    }
+
+    /* Nothing to do if the source contributes nothing and the
+     * destination is kept as it is */
+    if(BlendFactorIs(state->src_blend, alpha, 0) && BlendFactorIs(state->dst_blend, alpha, 255)) {
+        return;
+    }
+
+    *dst = Blend(state->src_blend, state->dst_blend, color, *dst);
+}
+
+#ifdef __SSE2__
+/* Finds which pixels of the block at (bx, by) are inside all three edges,
+ * one byte per row with bit n set for column bx + n. The edges are tested
+ * on four pixels at a time in 32 bits, which is exact as long as every
+ * value over the block fits. Steps are wrapped to 32 bits, as the sums
+ * they produce still do. Returns false if they don't fit. */
+static bool BlockCoverage(const Triangle* tri, int bx, int by, uint8_t* rows) {
+    const EdgeEquation* edges[3] = {&tri->e0, &tri->e1, &tri->e2};
+    const int64_t span = BLOCK_SIZE - 1;
+
+    __m128i left[3], right[3], step[3];
+
+    for(int i = 0; i < 3; ++i) {
+        const EdgeEquation* e = edges[i];
+        const int64_t v = EdgeEquationEvaluate(e, bx, by) + EdgeEquationBias(e);
+        const int64_t hi = v + MAX(e->a, 0) * span + MAX(e->b, 0) * span;
+        const int64_t lo = v + MIN(e->a, 0) * span + MIN(e->b, 0) * span;
+
+        if(lo < INT32_MIN || hi > INT32_MAX) {
+            return false;
+        }
+
+        const uint32_t v32 = (uint32_t) v;
+        const uint32_t a32 = (uint32_t) e->a;
+
+        left[i] = _mm_setr_epi32(v32, v32 + a32, v32 + 2 * a32, v32 + 3 * a32);
+        right[i] = _mm_add_epi32(left[i], _mm_set1_epi32(4 * a32));
+        step[i] = _mm_set1_epi32((uint32_t) e->b);
+    }
+
+    for(int y = 0; y < BLOCK_SIZE; ++y) {
+        /* A pixel is outside if any of its values is negative */
+        const __m128i l = _mm_or_si128(_mm_or_si128(left[0], left[1]), left[2]);
+        const __m128i r = _mm_or_si128(_mm_or_si128(right[0], right[1]), right[2]);
+        const int outside = _mm_movemask_ps(_mm_castsi128_ps(l)) |
+                            (_mm_movemask_ps(_mm_castsi128_ps(r)) << 4);
+
+        rows[y] = (uint8_t) ~outside;
+
+        for(int i = 0; i < 3; ++i) {
+            left[i] = _mm_add_epi32(left[i], step[i]);
+            right[i] = _mm_add_epi32(right[i], step[i]);
+        }
+    }
+
+    return true;
+}
+#endif
+
+/* Rasterizes the pixels of [x0, x1) x [y0, y1), which lie within the
+ * block at (bx, by). If covered is set the whole block is known to be
+ * inside all three edges so no edge tests are needed. */
+static void RasterizeBlock(const Triangle* tri, const PolyState* state, const Interpolants* dx,
+                           int bx, int by, int x0, int y0, int x1, int y1, bool covered) {
+
+    if(covered) {
+        for(int y = y0; y < y1; ++y) {
+            uint32_t* dst = COLOR_BUFFER + (y * vid_mode.width);
+            float* depth = DEPTH_BUFFER + (y * vid_mode.width);
+
+            Interpolants it;
+            InterpolantsInit(&it, tri, state->textured, x0, y);
+
+            for(int x = x0; x < x1; ++x) {
+                ShadeFragment(state, &it, dst + x, depth + x);
+                InterpolantsStep(&it, dx);
+            }
+        }
+
+        return;
+    }
+
+#ifdef __SSE2__
+    uint8_t rows[BLOCK_SIZE];
+
+    if(BlockCoverage(tri, bx, by, rows)) {
+        for(int y = y0; y < y1; ++y) {
+            uint32_t mask = rows[y - by] >> (x0 - bx);
+
+            /* Skip rows the triangle misses without setting them up */
+            if(!mask) {
+                continue;
+            }
+
+            uint32_t* dst = COLOR_BUFFER + (y * vid_mode.width);
+            float* depth = DEPTH_BUFFER + (y * vid_mode.width);
+
+            Interpolants it;
+            InterpolantsInit(&it, tri, state->textured, x0, y);
+
+            for(int x = x0; x < x1; ++x, mask >>= 1) {
+                if(mask & 1) {
+                    ShadeFragment(state, &it, dst + x, depth + x);
+                }
+
+                InterpolantsStep(&it, dx);
+            }
+        }
+
+        return;
+    }
+#endif
+
+    const int64_t bias0 = EdgeEquationBias(&tri->e0);
+    const int64_t bias1 = EdgeEquationBias(&tri->e1);
+    const int64_t bias2 = EdgeEquationBias(&tri->e2);
+
+    for(int y = y0; y < y1; ++y) {
+        uint32_t* dst = COLOR_BUFFER + (y * vid_mode.width);
+        float* depth = DEPTH_BUFFER + (y * vid_mode.width);
+
+        Interpolants it;
+        InterpolantsInit(&it, tri, state->textured, x0, y);
 
-    ParameterEquationInit(&r, v0->bgra[2], v1->bgra[2], v2->bgra[2], &e0, &e1, &e2, area);
-    ParameterEquationInit(&g, v0->bgra[1], v1->bgra[1], v2->bgra[1], &e0, &e1, &e2, area);
-    ParameterEquationInit(&b, v0->bgra[0], v1->bgra[0], v2->bgra[0], &e0, &e1, &e2, area);
+        int64_t w0 = EdgeEquationEvaluate(&tri->e0, x0, y) + bias0;
+        int64_t w1 = EdgeEquationEvaluate(&tri->e1, x0, y) + bias1;
+        int64_t w2 = EdgeEquationEvaluate(&tri->e2, x0, y) + bias2;
 
-    // Add 0.5 to sample at pixel centers.
-    for (float x = minX + 0.5f, xm = maxX + 0.5f; x <= xm; x += 1.0f)
-    for (float y = minY + 0.5f, ym = maxY + 0.5f; y <= ym; y += 1.0f)
-    {
-      if (EdgeEquationTestPoint(&e0, x, y) && EdgeEquationTestPoint(&e1, x, y) && EdgeEquationTestPoint(&e2, x, y)) {
-        int rint = ParameterEquationEvaluate(&r, x, y);
-        int gint = ParameterEquationEvaluate(&g, x, y);
-        int bint = ParameterEquationEvaluate(&b, x, y);
-        SDL_SetRenderDrawColor(RENDERER, rint, gint, bint, 255);
-        SDL_RenderDrawPoint(RENDERER, x, y);
-      }
+        for(int x = x0; x < x1; ++x) {
+            /* With the tie rule folded into the bias, a pixel is
+             * inside when no value is negative */
+            if((w0 | w1 | w2) >= 0) {
+                ShadeFragment(state, &it, dst + x, depth + x);
+            }
+
+            w0 += tri->e0.a;
+            w1 += tri->e1.a;
+            w2 += tri->e2.a;
+            InterpolantsStep(&it, dx);
+        }
     }
 }
 
+/* The furthest depth stored in a block */
+static float BlockMinDepth(int bx, int by) {
+    const int x1 = MIN(bx + BLOCK_SIZE, vid_mode.width);
+    const int y1 = MIN(by + BLOCK_SIZE, vid_mode.height);
+
+    float z = DEPTH_BUFFER[by * vid_mode.width + bx];
+    for(int y = by; y < y1; ++y) {
+        const float* depth = DEPTH_BUFFER + (y * vid_mode.width);
+        for(int x = bx; x < x1; ++x) {
+            z = MIN(z, depth[x]);
+        }
+    }
+
+    return z;
+}
+
+/* Recomputes a tile's bound from its blocks */
+static void UpdateTileHiZ(int tile, int tx0, int ty0, int tx1, int ty1) {
+    float z = HIZ_BLOCKS[(ty0 / BLOCK_SIZE) * BLOCKS_X + (tx0 / BLOCK_SIZE)];
+
+    for(int by = ty0 / BLOCK_SIZE; by < (ty1 + BLOCK_SIZE - 1) / BLOCK_SIZE; ++by) {
+        for(int bx = tx0 / BLOCK_SIZE; bx < (tx1 + BLOCK_SIZE - 1) / BLOCK_SIZE; ++bx) {
+            z = MIN(z, HIZ_BLOCKS[by * BLOCKS_X + bx]);
+        }
+    }
+
+    HIZ_TILES[tile] = z;
+}
+
+/* Only these compares can be decided from a lower bound on the stored
+ * depth. They also never lower the stored values. */
+static inline bool HiZCanReject(GPUDepthCompare func) {
+    return func == GPU_DEPTHCMP_GREATER || func == GPU_DEPTHCMP_GEQUAL;
+}
+
+static void RasterizeTriangle(const Triangle* tri, int tile, int tx0, int ty0, int tx1, int ty1) {
+    const PolyState* state = (const PolyState*) aligned_vector_at(&STATES, tri->state);
+    GPUStats* stats = &TILE_STATS[tile];
+
+    const bool hiz_test = HiZCanReject(state->depth_func);
+
+    if(hiz_test) {
+        stats->hiz_triangles_tested++;
+
+        if(tri->z_max + HIZ_EPSILON < HIZ_TILES[tile]) {
+            stats->hiz_triangles_rejected++;
+            return;
+        }
+    }
+
+    /* Writing fragments which pass or keep the nearer value can only
+     * raise a block's bound, unless alpha testing may discard some of
+     * them. Other compares may write further values. */
+    const bool writes = state->depth_write == GPU_DEPTHWRITE_ENABLE &&
+        state->depth_func != GPU_DEPTHCMP_NEVER;
+    const bool hiz_raise = writes && hiz_test && !state->alpha_test;
+    const bool hiz_lower = writes && !hiz_test;
+    bool hiz_raised = false;
+
+    const int minX = MAX(tri->min_x, tx0);
+    const int maxX = MIN(tri->max_x, tx1);
+    const int minY = MAX(tri->min_y, ty0);
+    const int maxY = MIN(tri->max_y, ty1);
+
+    const EdgeEquation* edges[3] = {&tri->e0, &tri->e1, &tri->e2};
+
+    const Interpolants dx = {
+        tri->z.a,
+        tri->r.a, tri->g.a, tri->b.a, tri->a.a,
+        tri->invw.a, tri->u.a, tri->v.a
+    };
+
+    /* Distance between the first and last pixels of a block */
+    const int64_t span = BLOCK_SIZE - 1;
+
+    for(int by = minY & ~(BLOCK_SIZE - 1); by < maxY; by += BLOCK_SIZE) {
+        for(int bx = minX & ~(BLOCK_SIZE - 1); bx < maxX; bx += BLOCK_SIZE) {
+            /* Each edge is linear, so its extremes over the block are at
+             * the corners picked by the signs of a and b */
+            bool covered = true;
+            bool rejected = false;
+
+            for(int i = 0; i < 3; ++i) {
+                const EdgeEquation* e = edges[i];
+                const int64_t v = EdgeEquationEvaluate(e, bx, by) + EdgeEquationBias(e);
+                const int64_t hi = v + MAX(e->a, 0) * span + MAX(e->b, 0) * span;
+                const int64_t lo = v + MIN(e->a, 0) * span + MIN(e->b, 0) * span;
+
+                if(hi < 0) {
+                    rejected = true;
+                    break;
+                }
+
+                if(lo < 0) {
+                    covered = false;
+                }
+            }
+
+            if(rejected) {
+                continue;
+            }
+
+            /* Likewise for depth, clamped to the range of the triangle */
+            const float z = ParameterEquationEvaluate(&tri->z, bx, by);
+            const float z_hi = MIN(z + (MAX(tri->z.a, 0.0f) + MAX(tri->z.b, 0.0f)) * span, tri->z_max);
+            const float z_lo = MAX(z + (MIN(tri->z.a, 0.0f) + MIN(tri->z.b, 0.0f)) * span, tri->z_min);
+
+            float* hiz = &HIZ_BLOCKS[(by / BLOCK_SIZE) * BLOCKS_X + (bx / BLOCK_SIZE)];
+
+            if(hiz_test) {
+                stats->hiz_blocks_tested++;
+
+                if(z_hi + HIZ_EPSILON < *hiz) {
+                    stats->hiz_blocks_rejected++;
+                    continue;
+                }
+            }
+
+            RasterizeBlock(
+                tri, state, &dx, bx, by,
+                MAX(bx, minX), MAX(by, minY),
+                MIN(bx + BLOCK_SIZE, maxX), MIN(by + BLOCK_SIZE, maxY),
+                covered
+            );
+
+            if(hiz_raise) {
+                /* Partially covered blocks are read back, which is exact */
+                const float z_min = (covered) ? z_lo - HIZ_EPSILON : BlockMinDepth(bx, by);
+                if(z_min > *hiz) {
+                    *hiz = z_min;
+                    hiz_raised = true;
+                }
+            } else if(hiz_lower && z_lo - HIZ_EPSILON < *hiz) {
+                *hiz = z_lo - HIZ_EPSILON;
+                HIZ_TILES[tile] = MIN(HIZ_TILES[tile], *hiz);
+            }
+        }
+    }
+
+    if(hiz_raised) {
+        UpdateTileHiZ(tile, tx0, ty0, tx1, ty1);
+    }
+}
+
+static int CompareSortEntries(const void* a, const void* b) {
+    const SortEntry* lhs = (const SortEntry*) a;
+    const SortEntry* rhs = (const SortEntry*) b;
+
+    /* Smaller Z is further away. Ties keep submission order */
+    if(lhs->depth != rhs->depth) {
+        return (lhs->depth < rhs->depth) ? -1 : 1;
+    }
+
+    return (lhs->index < rhs->index) ? -1 : (lhs->index > rhs->index);
+}
+
+/* Reorders a tile's bin back to front. Each triangle is keyed on its
+ * depth at the centre of the area it covers within the tile. */
+static void SortTile(int tile, int tx0, int ty0, int tx1, int ty1) {
+    AlignedVector* bin = &TILE_BINS[tile];
+    AlignedVector* scratch = &TILE_SORT[tile];
+    uint32_t* indexes = (uint32_t*) bin->data;
+
+    SortEntry* entries = (SortEntry*) aligned_vector_resize(scratch, bin->size);
+
+    for(uint32_t i = 0; i < bin->size; ++i) {
+        const Triangle* tri = (const Triangle*) aligned_vector_at(&TRIANGLES, indexes[i]);
+
+        const float cx = (MAX(tri->min_x, tx0) + MIN(tri->max_x, tx1) - 1) * 0.5f;
+        const float cy = (MAX(tri->min_y, ty0) + MIN(tri->max_y, ty1) - 1) * 0.5f;
+
+        entries[i].depth = ParameterEquationEvaluate(&tri->z, cx, cy);
+        entries[i].index = indexes[i];
+    }
+
+    qsort(entries, bin->size, sizeof(SortEntry), CompareSortEntries);
+
+    for(uint32_t i = 0; i < bin->size; ++i) {
+        indexes[i] = entries[i].index;
+    }
+}
+
+static void RasterizeTile(int tile) {
+    const AlignedVector* bin = &TILE_BINS[tile];
+    const uint32_t* indexes = (const uint32_t*) bin->data;
+
+    const int tx0 = (tile % TILES_X) * TILE_SIZE;
+    const int ty0 = (tile / TILES_X) * TILE_SIZE;
+    const int tx1 = MIN(tx0 + TILE_SIZE, vid_mode.width);
+    const int ty1 = MIN(ty0 + TILE_SIZE, vid_mode.height);
+
+    if(AUTOSORT && CURRENT_LIST == GPU_LIST_TR_POLY && bin->size > 1) {
+        SortTile(tile, tx0, ty0, tx1, ty1);
+    }
+
+    for(uint32_t i = 0; i < bin->size; ++i) {
+        const Triangle* tri = (const Triangle*) aligned_vector_at(&TRIANGLES, indexes[i]);
+        RasterizeTriangle(tri, tile, tx0, ty0, tx1, ty1);
+    }
+}
+
+static void RasterizeTiles() {
+    int tile;
+    while((tile = __sync_fetch_and_add(&NEXT_TILE, 1)) < TILE_COUNT) {
+        if(TILE_BINS[tile].size) {
+            RasterizeTile(tile);
+        }
+    }
+}
+
+static void* WorkerThread(void* arg) {
+    (void) arg;
+
+    uint32_t generation = 0;
+
+    for(;;) {
+        pthread_mutex_lock(&WORK_MUTEX);
+        while(generation == WORK_GENERATION) {
+            pthread_cond_wait(&WORK_READY, &WORK_MUTEX);
+        }
+        generation = WORK_GENERATION;
+        pthread_mutex_unlock(&WORK_MUTEX);
+
+        RasterizeTiles();
+
+        pthread_mutex_lock(&WORK_MUTEX);
+        if(--WORKERS_BUSY == 0) {
+            pthread_cond_signal(&WORK_DONE);
+        }
+        pthread_mutex_unlock(&WORK_MUTEX);
+    }
+
+    return NULL;
+}
+
+/* Rasterizes every binned tile, using the calling thread as
+ * well as the worker pool. Returns once all tiles are done. */
+static void DispatchTiles() {
+    pthread_mutex_lock(&WORK_MUTEX);
+    NEXT_TILE = 0;
+    WORKERS_BUSY = WORKER_COUNT;
+    WORK_GENERATION++;
+    pthread_cond_broadcast(&WORK_READY);
+    pthread_mutex_unlock(&WORK_MUTEX);
+
+    RasterizeTiles();
+
+    pthread_mutex_lock(&WORK_MUTEX);
+    while(WORKERS_BUSY) {
+        pthread_cond_wait(&WORK_DONE, &WORK_MUTEX);
+    }
+    pthread_mutex_unlock(&WORK_MUTEX);
+}
+
+static void InitTiles() {
+    TILES_X = (vid_mode.width + TILE_SIZE - 1) / TILE_SIZE;
+    TILES_Y = (vid_mode.height + TILE_SIZE - 1) / TILE_SIZE;
+    TILE_COUNT = TILES_X * TILES_Y;
+
+    COLOR_BUFFER = (uint32_t*) malloc(vid_mode.width * vid_mode.height * sizeof(uint32_t));
+    DEPTH_BUFFER = (float*) malloc(vid_mode.width * vid_mode.height * sizeof(float));
+
+    BLOCKS_X = (vid_mode.width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    const int blocks_y = (vid_mode.height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    HIZ_BLOCKS = (float*) malloc(BLOCKS_X * blocks_y * sizeof(float));
+    HIZ_TILES = (float*) malloc(TILE_COUNT * sizeof(float));
+    TILE_STATS = (GPUStats*) calloc(TILE_COUNT, sizeof(GPUStats));
+
+    aligned_vector_init(&STATES, sizeof(PolyState));
+    aligned_vector_init(&TRIANGLES, sizeof(Triangle));
+
+    TILE_BINS = (AlignedVector*) malloc(sizeof(AlignedVector) * TILE_COUNT);
+    TILE_SORT = (AlignedVector*) malloc(sizeof(AlignedVector) * TILE_COUNT);
+    for(int i = 0; i < TILE_COUNT; ++i) {
+        aligned_vector_init(&TILE_BINS[i], sizeof(uint32_t));
+        aligned_vector_init(&TILE_SORT[i], sizeof(SortEntry));
+    }
+
+    /* The submitting thread rasterizes too, so spawn one less than
+     * the number of cores */
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    WORKER_COUNT = CLAMP((int) cores - 1, 0, MAX_WORKER_THREADS);
+
+    for(int i = 0; i < WORKER_COUNT; ++i) {
+        if(pthread_create(&WORKERS[i], NULL, WorkerThread, NULL) != 0) {
+            WORKER_COUNT = i;
+            break;
+        }
+    }
+}
+
+void InitGPU(_Bool autosort, _Bool fsaa, _Bool headless) {
+    HEADLESS = headless;
+    AUTOSORT = autosort;
+
+    InitTiles();
+    SamplerInitTables();
+
+    if(HEADLESS) {
+        return;
+    }
 
-void InitGPU(_Bool autosort, _Bool fsaa) {
     SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS);
 
     WINDOW = SDL_CreateWindow(
@@ -128,15 +1046,48 @@ void InitGPU(_Bool autosort, _Bool fsaa) {
     RENDERER = SDL_CreateRenderer(
         WINDOW, -1, SDL_RENDERER_ACCELERATED
     );
+
+    FRAMEBUFFER_TEXTURE = SDL_CreateTexture(
+        RENDERER, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+        vid_mode.width, vid_mode.height
+    );
 }
 
 void SceneBegin() {
-    SDL_SetRenderDrawColor(RENDERER, BACKGROUND_COLOR[0], BACKGROUND_COLOR[1], BACKGROUND_COLOR[2], 0);
-    SDL_RenderClear(RENDERER);
+    SamplerBeginFrame();
+
+    const uint32_t clear = 0xFF000000 |
+        (BACKGROUND_COLOR[0] << 16) |
+        (BACKGROUND_COLOR[1] << 8) |
+        BACKGROUND_COLOR[2];
+
+    const int count = vid_mode.width * vid_mode.height;
+    for(int i = 0; i < count; ++i) {
+        COLOR_BUFFER[i] = clear;
+        DEPTH_BUFFER[i] = CLEAR_DEPTH;
+    }
+
+    const int blocks = BLOCKS_X * ((vid_mode.height + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    for(int i = 0; i < blocks; ++i) {
+        HIZ_BLOCKS[i] = CLEAR_DEPTH;
+    }
+
+    for(int i = 0; i < TILE_COUNT; ++i) {
+        HIZ_TILES[i] = CLEAR_DEPTH;
+    }
+
+    memset(&STATS, 0, sizeof(STATS));
 }
 
 void SceneListBegin(GPUList list) {
+    CURRENT_LIST = list;
+
+    aligned_vector_clear(&STATES);
+    aligned_vector_clear(&TRIANGLES);
 
+    for(int i = 0; i < TILE_COUNT; ++i) {
+        aligned_vector_clear(&TILE_BINS[i]);
+    }
 }
 
 void SceneListSubmit(void* src, int n) {
@@ -153,6 +1104,34 @@ void SceneListSubmit(void* src, int n) {
             uint32_t mask = mode1 & GPU_TA_PM1_CULLING_MASK;
             CULL_MODE = mask >> GPU_TA_PM1_CULLING_SHIFT;
 
+            uint32_t mode2 = *(flags + 2);
+            uint32_t mode3 = *(flags + 3);
+
+            PolyState* state = (PolyState*) aligned_vector_extend(&STATES, 1);
+
+            state->depth_write = (mode1 & GPU_TA_PM1_DEPTHWRITE_MASK) >> GPU_TA_PM1_DEPTHWRITE_SHIFT;
+
+            /* Like the PVR, punch-through polys ignore the compare mode
+             * in the header and always keep the nearest fragment */
+            state->depth_func = (CURRENT_LIST == GPU_LIST_PT_POLY) ?
+                GPU_DEPTHCMP_GEQUAL :
+                (mode1 & GPU_TA_PM1_DEPTHCMP_MASK) >> GPU_TA_PM1_DEPTHCMP_SHIFT;
+
+            state->vertex_alpha = (mode2 & GPU_TA_PM2_ALPHA_MASK) != 0;
+
+            state->alpha_test = (CURRENT_LIST == GPU_LIST_PT_POLY);
+            state->src_blend = (mode2 & GPU_TA_PM2_SRCBLEND_MASK) >> GPU_TA_PM2_SRCBLEND_SHIFT;
+            state->dst_blend = (mode2 & GPU_TA_PM2_DSTBLEND_MASK) >> GPU_TA_PM2_DSTBLEND_SHIFT;
+            state->blend = !(state->src_blend == GPU_BLEND_ONE && state->dst_blend == GPU_BLEND_ZERO);
+
+            state->textured = (mode1 & GPU_TA_PM1_TXRENABLE_MASK) != 0;
+            if(state->textured) {
+                /* The flag is set when texture alpha should be ignored */
+                state->texture_alpha = (mode2 & GPU_TA_PM2_TXRALPHA_MASK) == 0;
+                state->env = (mode2 & GPU_TA_PM2_TXRENV_MASK) >> GPU_TA_PM2_TXRENV_SHIFT;
+                SamplerInit(&state->sampler, mode2, mode3, VRAM);
+            }
+
         } else {
             switch(*flags) {
             case GPU_CMD_VERTEX_EOL:
@@ -168,7 +1147,7 @@ void SceneListSubmit(void* src, int n) {
             GPUVertex* v0 = (GPUVertex*) (flags - step - step);
             GPUVertex* v1 = (GPUVertex*) (flags - step);
             GPUVertex* v2 = (GPUVertex*) (flags);
-            (vertex_counter % 2 == 0) ? DrawTriangle(v0, v1, v2) : DrawTriangle(v1, v0, v2);
+            (vertex_counter % 2 == 0) ? SubmitTriangle(v0, v1, v2) : SubmitTriangle(v1, v0, v2);
         }
 
         if((*flags) == GPU_CMD_VERTEX_EOL) {
@@ -178,10 +1157,29 @@ void SceneListSubmit(void* src, int n) {
 }
 
 void SceneListFinish() {
+    if(!TRIANGLES.size) {
+        return;
+    }
 
+    DispatchTiles();
+
+    for(int i = 0; i < TILE_COUNT; ++i) {
+        GPUStats* stats = &TILE_STATS[i];
+        STATS.hiz_triangles_tested += stats->hiz_triangles_tested;
+        STATS.hiz_triangles_rejected += stats->hiz_triangles_rejected;
+        STATS.hiz_blocks_tested += stats->hiz_blocks_tested;
+        STATS.hiz_blocks_rejected += stats->hiz_blocks_rejected;
+        memset(stats, 0, sizeof(GPUStats));
+    }
 }
 
 void SceneFinish() {
+    if(HEADLESS) {
+        return;
+    }
+
+    SDL_UpdateTexture(FRAMEBUFFER_TEXTURE, NULL, COLOR_BUFFER, vid_mode.width * sizeof(uint32_t));
+    SDL_RenderCopy(RENDERER, FRAMEBUFFER_TEXTURE, NULL, NULL);
     SDL_RenderPresent(RENDERER);
 
     /* Only sensible place to hook the quit signal */
@@ -198,6 +1196,14 @@ void SceneFinish() {
     }
 }
 
+void GPUGetStats(GPUStats* stats) {
+    *stats = STATS;
+}
+
+const uint32_t* GPUFramebuffer() {
+    return COLOR_BUFFER;
+}
+
 void UploadMatrix4x4(const Matrix4x4* mat) {
     memcpy(&MATRIX, mat, sizeof(Matrix4x4));
 }
@@ -241,20 +1247,29 @@ size_t GPUMemoryAvailable() {
 }
 
 void* GPUMemoryAlloc(size_t size) {
+    /* Keep allocations 32 byte aligned like PVR memory */
+    size = (size + 31) & ~31;
+
     if(size > AVAILABLE_VRAM) {
         return NULL;
-    } else {
-        AVAILABLE_VRAM -= size;
-        return malloc(size);
     }
+
+    if(!VRAM && posix_memalign((void**) &VRAM, VRAM_SIZE, VRAM_SIZE) != 0) {
+        VRAM = NULL;
+        return NULL;
+    }
+
+    void* ret = VRAM + (VRAM_SIZE - AVAILABLE_VRAM);
+    AVAILABLE_VRAM -= size;
+    return ret;
 }
 
 void GPUSetPaletteFormat(GPUPaletteFormat format) {
-
+    SamplerSetPaletteFormat(format);
 }
 
 void GPUSetPaletteEntry(uint32_t idx, uint32_t value) {
-
+    SamplerSetPaletteEntry(idx, value);
 }
 
 void GPUSetBackgroundColour(float r, float g, float b) {
@@ -264,11 +1279,11 @@ void GPUSetBackgroundColour(float r, float g, float b) {
 }
 
 void GPUSetAlphaCutOff(uint8_t v) {
-
+    ALPHA_CUTOFF = v;
 }
 
 void GPUSetClearDepth(float v) {
-
+    CLEAR_DEPTH = v;
 }
 
 void GPUSetFogLinear(float start, float end) {
@@ -293,6 +1308,12 @@ void TransformVec3NoMod(const float* v, float* ret) {
     ret[2] = v[0] * MATRIX[2] + v[1] * MATRIX[6] + v[2] * MATRIX[10] + 1.0f * MATRIX[14];
 }
 
+void TransformNormalNoMod(const float* v, float* ret) {
+    ret[0] = v[0] * MATRIX[0] + v[1] * MATRIX[4] + v[2] * MATRIX[8];
+    ret[1] = v[0] * MATRIX[1] + v[1] * MATRIX[5] + v[2] * MATRIX[9];
+    ret[2] = v[0] * MATRIX[2] + v[1] * MATRIX[6] + v[2] * MATRIX[10];
+}
+
 void TransformVec4NoMod(const float* v, float* ret) {
     ret[0] = v[0] * MATRIX[0] + v[1] * MATRIX[4] + v[2] * MATRIX[8] + v[3] * MATRIX[12];
     ret[1] = v[0] * MATRIX[1] + v[1] * MATRIX[5] + v[2] * MATRIX[9] + v[3] * MATRIX[13];
@@ -312,20 +1333,94 @@ void TransformVec4(float* v) {
     FASTCPY(v, ret, sizeof(float) * 4);
 }
 
+#ifdef __SSE__
+
+/* The matrix columns, x * c0 + y * c1 + z * c2 + w * c3 gives the
+ * transformed vector. Summed in the same order as TransformVec4NoMod
+ * so that both give identical results. */
+typedef struct {
+    __m128 c0, c1, c2, c3;
+} MatrixColumns;
+
+static inline MatrixColumns LoadMatrixColumns() {
+    MatrixColumns m;
+    m.c0 = _mm_loadu_ps(&MATRIX[0]);
+    m.c1 = _mm_loadu_ps(&MATRIX[4]);
+    m.c2 = _mm_loadu_ps(&MATRIX[8]);
+    m.c3 = _mm_loadu_ps(&MATRIX[12]);
+    return m;
+}
+
+/* Transforms xyz (w == 1). Reads a fourth float past xyz, which is
+ * the u coordinate for a Vertex. */
+static inline __m128 TransformPoint(const MatrixColumns* m, const float* xyz) {
+    const __m128 p = _mm_loadu_ps(xyz);
+
+    __m128 r = _mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0)), m->c0);
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1)), m->c1));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2)), m->c2));
+    return _mm_add_ps(r, m->c3);
+}
+
+static inline void StoreVertexPosition(Vertex* v, const __m128 r) {
+    _mm_storel_pi((__m64*) v->xyz, r);
+    _mm_store_ss(&v->xyz[2], _mm_movehl_ps(r, r));
+    _mm_store_ss(&v->w, _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)));
+}
+
 void TransformVertices(Vertex* vertices, const int count) {
-    float ret[4];
-    for(int i = 0; i < count; ++i, ++vertices) {
-        ret[0] = vertices->xyz[0];
-        ret[1] = vertices->xyz[1];
-        ret[2] = vertices->xyz[2];
-        ret[3] = 1.0f;
+    const MatrixColumns m = LoadMatrixColumns();
+
+    int i = 0;
+
+    /* Each vertex's xyzw result fills a register, so the positions are
+     * transformed as they're laid out. Transposing four of them into x/y/z
+     * lanes and back costs more shuffles and adds than it saves.
+     * Four at a time so the independent transforms can overlap. */
+    for(; i + 4 <= count; i += 4, vertices += 4) {
+        const __m128 r0 = TransformPoint(&m, vertices[0].xyz);
+        const __m128 r1 = TransformPoint(&m, vertices[1].xyz);
+        const __m128 r2 = TransformPoint(&m, vertices[2].xyz);
+        const __m128 r3 = TransformPoint(&m, vertices[3].xyz);
+
+        StoreVertexPosition(&vertices[0], r0);
+        StoreVertexPosition(&vertices[1], r1);
+        StoreVertexPosition(&vertices[2], r2);
+        StoreVertexPosition(&vertices[3], r3);
+    }
 
-        TransformVec4(ret);
+    for(; i < count; ++i, ++vertices) {
+        StoreVertexPosition(vertices, TransformPoint(&m, vertices->xyz));
+    }
+}
 
-        vertices->xyz[0] = ret[0];
-        vertices->xyz[1] = ret[1];
-        vertices->xyz[2] = ret[2];
-        vertices->w = ret[3];
+void TransformVertex(const float* xyz, const float* w, float* oxyz, float* ow) {
+    const MatrixColumns m = LoadMatrixColumns();
+
+    __m128 r = _mm_mul_ps(_mm_set1_ps(xyz[0]), m.c0);
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(xyz[1]), m.c1));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(xyz[2]), m.c2));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(*w), m.c3));
+
+    _mm_storel_pi((__m64*) oxyz, r);
+    _mm_store_ss(&oxyz[2], _mm_movehl_ps(r, r));
+    _mm_store_ss(ow, _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)));
+}
+
+#else
+
+void TransformVertices(Vertex* vertices, const int count) {
+    const float* m = MATRIX;
+
+    for(int i = 0; i < count; ++i, ++vertices) {
+        const float x = vertices->xyz[0];
+        const float y = vertices->xyz[1];
+        const float z = vertices->xyz[2];
+
+        vertices->xyz[0] = x * m[0] + y * m[4] + z * m[8] + m[12];
+        vertices->xyz[1] = x * m[1] + y * m[5] + z * m[9] + m[13];
+        vertices->xyz[2] = x * m[2] + y * m[6] + z * m[10] + m[14];
+        vertices->w = x * m[3] + y * m[7] + z * m[11] + m[15];
     }
 }
 
@@ -343,3 +1438,5 @@ void TransformVertex(const float* xyz, const float* w, float* oxyz, float* ow) {
     oxyz[2] = ret[2];
     *ow = ret[3];
 }
+
+#endif
@@ -47,14 +47,17 @@ void TransformVec3(float* v);
 void TransformVec3NoMod(const float* v, float* ret);
 
 /* Transform a 3-element normal using the stored matrix (w == 0)*/
-static inline void TransformNormalNoMod(const float* xIn, float* xOut) {
-
-}
+void TransformNormalNoMod(const float* xIn, float* xOut);
 
 void TransformVertices(Vertex* vertices, const int count);
 void TransformVertex(const float* xyz, const float* w, float* oxyz, float* ow);
 
-void InitGPU(_Bool autosort, _Bool fsaa);
+void InitGPU(_Bool autosort, _Bool fsaa, _Bool headless);
+
+/* The ARGB8888 colour buffer, top row first */
+const uint32_t* GPUFramebuffer();
+
+void GPUGetStats(GPUStats* stats);
 
 enum GPUPaletteFormat;
 
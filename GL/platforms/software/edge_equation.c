@@ -1,20 +1,30 @@
 #include "edge_equation.h"
 
-void EdgeEquationInit(EdgeEquation* edge, const float* v0, const float* v1) {
-    edge->a = v0[1] - v1[1];
-    edge->b = v1[0] - v0[0];
-    edge->c = -(edge->a * (v0[0] + v1[0]) + edge->b * (v0[1] + v1[1])) / 2;
-    edge->tie = edge->a != 0 ? edge->a > 0 : edge->b > 0;
+void EdgeEquationInit(EdgeEquation* edge, const int32_t* v0, const int32_t* v1) {
+    const int64_t a = (int64_t) v0[1] - v1[1];
+    const int64_t b = (int64_t) v1[0] - v0[0];
+
+    /* Relative to the centre of pixel (0, 0) */
+    const int64_t half = SUBPIXEL_ONE / 2;
+
+    edge->a = a * SUBPIXEL_ONE;
+    edge->b = b * SUBPIXEL_ONE;
+    edge->c = a * (half - v0[0]) + b * (half - v0[1]);
+    edge->tie = a != 0 ? a > 0 : b > 0;
 }
 
-float EdgeEquationEvaluate(const EdgeEquation* edge, float x, float y) {
+int64_t EdgeEquationEvaluate(const EdgeEquation* edge, int x, int y) {
     return edge->a * x + edge->b * y + edge->c;
 }
 
-bool EdgeEquationTestValue(const EdgeEquation* edge, float value) {
-    return (value >= 0 || (value == 0 && edge->tie));
+int64_t EdgeEquationBias(const EdgeEquation* edge) {
+    return (edge->tie) ? 0 : -1;
+}
+
+bool EdgeEquationTestValue(const EdgeEquation* edge, int64_t value) {
+    return (value > 0 || (value == 0 && edge->tie));
 }
 
-bool EdgeEquationTestPoint(const EdgeEquation* edge, float x, float y) {
+bool EdgeEquationTestPoint(const EdgeEquation* edge, int x, int y) {
     return EdgeEquationTestValue(edge, EdgeEquationEvaluate(edge, x, y));
 }
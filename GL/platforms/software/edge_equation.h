@@ -3,15 +3,28 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+/* Vertex positions are snapped to 28.4 fixed point before setup */
+#define SUBPIXEL_BITS 4
+#define SUBPIXEL_ONE (1 << SUBPIXEL_BITS)
+
+/* Edge functions are evaluated at pixel centres and addressed by integer
+ * pixel coordinates, so a and b are the steps between neighbouring pixels.
+ * Values are exact, in units of 1/(SUBPIXEL_ONE^2) pixels. */
 typedef struct EdgeEquation {
-    float a;
-    float b;
-    float c;
+    int64_t a;
+    int64_t b;
+    int64_t c;
+
+    /* Pixels exactly on the edge belong to the triangle only if this is
+     * a top or left edge, so shared edges are drawn exactly once */
     bool tie;
 } EdgeEquation;
 
-void EdgeEquationInit(EdgeEquation* edge, const float* v0, const float* v1);
-float EdgeEquationEvaluate(const EdgeEquation* edge, float x, float y);
-bool EdgeEquationTestValue(const EdgeEquation* edge, float value);
-bool EdgeEquationTestPoint(const EdgeEquation* edge, float x, float y);
+void EdgeEquationInit(EdgeEquation* edge, const int32_t* v0, const int32_t* v1);
+int64_t EdgeEquationEvaluate(const EdgeEquation* edge, int x, int y);
+
+/* Added to values before a sign test, folding the tie rule into >= 0 */
+int64_t EdgeEquationBias(const EdgeEquation* edge);
 
+bool EdgeEquationTestValue(const EdgeEquation* edge, int64_t value);
+bool EdgeEquationTestPoint(const EdgeEquation* edge, int x, int y);
@@ -3,11 +3,13 @@
 
 void ParameterEquationInit(ParameterEquation* equation, float p0, float p1, float p2, const EdgeEquation* e0, const EdgeEquation* e1, const EdgeEquation* e2, float area) {
 
-    float factor = 1.0f / (2.0f * area);
+    /* Edge values are exact integers which can exceed the precision
+     * of a float, so combine them in double */
+    double factor = 1.0 / (2.0 * area);
 
-    equation->a = factor * (p0 * e0->a + p1 * e1->a + p2 * e2->a);
-    equation->b = factor * (p0 * e0->b + p1 * e1->b + p2 * e2->b);
-    equation->c = factor * (p0 * e0->c + p1 * e1->c + p2 * e2->c);
+    equation->a = factor * (p0 * (double) e0->a + p1 * (double) e1->a + p2 * (double) e2->a);
+    equation->b = factor * (p0 * (double) e0->b + p1 * (double) e1->b + p2 * (double) e2->b);
+    equation->c = factor * (p0 * (double) e0->c + p1 * (double) e1->c + p2 * (double) e2->c);
 }
 
 
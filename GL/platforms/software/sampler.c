@@ -0,0 +1,422 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "../../platform.h"
+#include "../../../containers/aligned_vector.h"
+#include "sampler.h"
+
+#define TWIDDLE_TABLE_SIZE 1024
+
+/* Bits of x spread out to every other bit, so that a twiddled
+ * (Morton order) offset is TABLE[y] | (TABLE[x] << 1) */
+static uint32_t TWIDDLE_TABLE[TWIDDLE_TABLE_SIZE];
+
+#define FORMAT_ARGB1555 0
+#define FORMAT_RGB565 1
+#define FORMAT_ARGB4444 2
+#define FORMAT_PAL4BPP 5
+#define FORMAT_PAL8BPP 6
+
+#define PALETTE_SIZE 1024
+
+/* Size of the codebook at the start of VQ textures (256 2x2 blocks) */
+#define VQ_CODEBOOK_SIZE 2048
+
+/* Decoded textures which aren't used for this many frames are dropped */
+#define DECODE_CACHE_MAX_AGE 60
+
+static uint32_t PALETTE[PALETTE_SIZE];
+static uint32_t PALETTE_FORMAT = GPU_PAL_ARGB4444;
+
+/* Bumped whenever the palette changes, so paletted textures
+ * decoded with the old entries are redone */
+static uint32_t PALETTE_VERSION = 0;
+
+typedef struct DecodeCacheEntry {
+    uint32_t mode3;
+    uint32_t width;
+    uint32_t height;
+
+    uint32_t hash;
+    uint32_t palette_version;
+    uint32_t frame;
+
+    uint32_t* texels;
+} DecodeCacheEntry;
+
+static AlignedVector DECODE_CACHE;
+static uint32_t FRAME = 0;
+
+void SamplerInitTables() {
+    for(uint32_t i = 0; i < TWIDDLE_TABLE_SIZE; ++i) {
+        uint32_t v = 0;
+        for(uint32_t b = 0; b < 10; ++b) {
+            v |= ((i >> b) & 1) << (b * 2);
+        }
+        TWIDDLE_TABLE[i] = v;
+    }
+
+    aligned_vector_init(&DECODE_CACHE, sizeof(DecodeCacheEntry));
+}
+
+void SamplerBeginFrame() {
+    ++FRAME;
+
+    /* Drop anything which hasn't been drawn for a while */
+    for(uint32_t i = 0; i < DECODE_CACHE.size;) {
+        DecodeCacheEntry* entry = (DecodeCacheEntry*) aligned_vector_at(&DECODE_CACHE, i);
+
+        if(FRAME - entry->frame > DECODE_CACHE_MAX_AGE) {
+            free(entry->texels);
+            *entry = *(DecodeCacheEntry*) aligned_vector_back(&DECODE_CACHE);
+            DECODE_CACHE.size--;
+        } else {
+            ++i;
+        }
+    }
+}
+
+void SamplerSetPaletteFormat(uint32_t format) {
+    if(format != PALETTE_FORMAT) {
+        PALETTE_FORMAT = format;
+        ++PALETTE_VERSION;
+    }
+}
+
+void SamplerSetPaletteEntry(uint32_t idx, uint32_t value) {
+    if(idx < PALETTE_SIZE && PALETTE[idx] != value) {
+        PALETTE[idx] = value;
+        ++PALETTE_VERSION;
+    }
+}
+
+static uint32_t Log2(uint32_t v) {
+    uint32_t r = 0;
+    while(v >>= 1) {
+        ++r;
+    }
+    return r;
+}
+
+/* Offsets of the full size level in mipmapped textures. The chain
+ * starts with the smallest level, after some padding. */
+static uint32_t MipmapBaseOffset(uint32_t size) {
+    uint32_t offset = 6;
+    for(uint32_t s = 1; s < size; s *= 2) {
+        offset += s * s * 2;
+    }
+    return offset;
+}
+
+static uint32_t PalettedMipmapBaseOffset(uint32_t size) {
+    uint32_t offset = 3;
+    for(uint32_t s = 1; s < size; s *= 2) {
+        offset += s * s;
+    }
+    return offset;
+}
+
+/* Relative to the end of the codebook. Each index covers 2x2 texels, the
+ * 1x1 and 2x2 levels take a byte each. */
+static uint32_t VQMipmapBaseOffset(uint32_t size) {
+    if(size == 1) {
+        return 0;
+    }
+
+    uint32_t offset = 1;
+    for(uint32_t s = 2; s < size; s *= 2) {
+        offset += (s / 2) * (s / 2);
+    }
+    return offset;
+}
+
+static inline uint32_t TwiddledOffset(uint32_t x, uint32_t y, uint32_t mask, uint32_t shift) {
+    const uint32_t square = (x >> shift) + (y >> shift);
+
+    return (
+        TWIDDLE_TABLE[y & mask] |
+        (TWIDDLE_TABLE[x & mask] << 1)
+    ) + (square << (shift * 2));
+}
+
+static inline uint32_t DecodeTexel(uint32_t format, uint16_t p);
+
+static uint32_t DecodePaletteEntry(uint32_t value) {
+    if(PALETTE_FORMAT == GPU_PAL_ARGB8888) {
+        return value;
+    }
+
+    /* The 16bpp palette formats match the texture formats */
+    return DecodeTexel(PALETTE_FORMAT, value & 0xFFFF);
+}
+
+static uint32_t Hash(uint32_t hash, const uint8_t* data, uint32_t size) {
+    /* FNV-1a */
+    for(uint32_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void DecodePaletted(const Sampler* s, uint32_t mode3, uint32_t* out) {
+    const bool pal4 = s->format == FORMAT_PAL4BPP;
+
+    /* The bank select lives where the twiddle/stride bits usually are */
+    const uint32_t bank = (pal4) ? ((mode3 >> 21) & 63) * 16 : ((mode3 >> 25) & 3) * 256;
+    const uint32_t count = (pal4) ? 16 : 256;
+
+    uint32_t lut[256];
+    for(uint32_t i = 0; i < count; ++i) {
+        lut[i] = DecodePaletteEntry(PALETTE[(bank + i) & (PALETTE_SIZE - 1)]);
+    }
+
+    for(uint32_t y = 0; y < s->height; ++y) {
+        for(uint32_t x = 0; x < s->width; ++x) {
+            const uint32_t offset = TwiddledOffset(x, y, s->twiddle_mask, s->twiddle_shift);
+
+            uint32_t idx;
+            if(pal4) {
+                const uint8_t b = s->data[offset >> 1];
+                idx = (offset & 1) ? (b >> 4) : (b & 0xF);
+            } else {
+                idx = s->data[offset];
+            }
+
+            *out++ = lut[idx];
+        }
+    }
+}
+
+static void DecodeVQ(const Sampler* s, const uint8_t* indexes, uint32_t* out) {
+    const uint16_t* codebook = (const uint16_t*) s->data;
+
+    /* The index image is half the size in each direction */
+    const uint32_t mask = s->twiddle_mask >> 1;
+    const uint32_t shift = (s->twiddle_shift) ? s->twiddle_shift - 1 : 0;
+    const uint32_t stride = s->width / 2;
+
+    for(uint32_t y = 0; y < s->height; ++y) {
+        for(uint32_t x = 0; x < s->width; ++x) {
+            const uint32_t bx = x / 2, by = y / 2;
+            const uint32_t offset = (s->twiddled) ?
+                TwiddledOffset(bx, by, mask, shift) : (by * stride) + bx;
+
+            /* Each codebook entry is a twiddled 2x2 block */
+            const uint32_t texel = ((x & 1) << 1) | (y & 1);
+
+            *out++ = DecodeTexel(s->format, codebook[indexes[offset] * 4 + texel]);
+        }
+    }
+}
+
+/* Returns the decoded texels for a paletted or VQ texture, decoding
+ * only if the source data (or the palette) changed since last time */
+static const uint32_t* DecodeCached(const Sampler* s, uint32_t mode3, const uint8_t* indexes) {
+    const bool vq = (mode3 & GPU_TXRFMT_VQ_ENABLE) != 0;
+    const uint32_t texels = s->width * s->height;
+
+    DecodeCacheEntry* entry = NULL;
+    for(uint32_t i = 0; i < DECODE_CACHE.size; ++i) {
+        DecodeCacheEntry* it = (DecodeCacheEntry*) aligned_vector_at(&DECODE_CACHE, i);
+        if(it->mode3 == mode3 && it->width == s->width && it->height == s->height) {
+            entry = it;
+            break;
+        }
+    }
+
+    const uint32_t palette_version = (vq) ? 0 : PALETTE_VERSION;
+
+    /* Already checked this frame */
+    if(entry && entry->frame == FRAME && entry->palette_version == palette_version) {
+        return entry->texels;
+    }
+
+    uint32_t hash = 2166136261u;
+    if(vq) {
+        hash = Hash(hash, s->data, VQ_CODEBOOK_SIZE);
+        hash = Hash(hash, indexes, texels / 4);
+    } else {
+        hash = Hash(hash, s->data, (s->format == FORMAT_PAL4BPP) ? texels / 2 : texels);
+    }
+
+    if(!entry) {
+        DecodeCacheEntry e;
+        e.mode3 = mode3;
+        e.width = s->width;
+        e.height = s->height;
+        e.texels = (uint32_t*) malloc(texels * sizeof(uint32_t));
+        e.hash = ~hash;
+
+        if(!e.texels) {
+            return NULL;
+        }
+
+        entry = (DecodeCacheEntry*) aligned_vector_push_back(&DECODE_CACHE, &e, 1);
+    }
+
+    if(entry->hash != hash || entry->palette_version != palette_version) {
+        if(vq) {
+            DecodeVQ(s, indexes, entry->texels);
+        } else {
+            DecodePaletted(s, mode3, entry->texels);
+        }
+
+        entry->hash = hash;
+        entry->palette_version = palette_version;
+    }
+
+    entry->frame = FRAME;
+    return entry->texels;
+}
+
+void SamplerInit(Sampler* sampler, uint32_t mode2, uint32_t mode3, const uint8_t* vram) {
+    sampler->width = 8 << ((mode2 & GPU_TA_PM2_USIZE_MASK) >> GPU_TA_PM2_USIZE_SHIFT);
+    sampler->height = 8 << ((mode2 & GPU_TA_PM2_VSIZE_MASK) >> GPU_TA_PM2_VSIZE_SHIFT);
+
+    sampler->format = (mode3 >> 27) & 7;
+
+    /* Paletted textures are always twiddled, the bit is used for the bank */
+    const bool paletted = sampler->format == FORMAT_PAL4BPP || sampler->format == FORMAT_PAL8BPP;
+    const bool vq = (mode3 & GPU_TXRFMT_VQ_ENABLE) != 0;
+    const bool mipmapped = (mode3 & GPU_TA_PM3_MIPMAP_MASK) != 0;
+
+    sampler->twiddled = paletted || !(mode3 & GPU_TXRFMT_NONTWIDDLED);
+
+    uint32_t min = (sampler->width < sampler->height) ? sampler->width : sampler->height;
+    sampler->twiddle_mask = min - 1;
+    sampler->twiddle_shift = Log2(min);
+
+    uint32_t filter = (mode2 & GPU_TA_PM2_FILTER_MASK) >> GPU_TA_PM2_FILTER_SHIFT;
+    sampler->bilinear = filter != GPU_FILTER_NEAREST;
+
+    uint32_t clamp = (mode2 & GPU_TA_PM2_UVCLAMP_MASK) >> GPU_TA_PM2_UVCLAMP_SHIFT;
+    sampler->clamp_u = (clamp & GPU_UVCLAMP_U) != 0;
+    sampler->clamp_v = (clamp & GPU_UVCLAMP_V) != 0;
+
+    uint32_t flip = (mode2 & GPU_TA_PM2_UVFLIP_MASK) >> GPU_TA_PM2_UVFLIP_SHIFT;
+    sampler->flip_u = (flip & GPU_UVFLIP_U) != 0;
+    sampler->flip_v = (flip & GPU_UVFLIP_V) != 0;
+
+    sampler->data = vram + ((mode3 & 0x1FFFFF) << 3);
+    sampler->decoded = NULL;
+
+    /* FIXME: Only the full size level is sampled */
+    if(vq) {
+        const uint8_t* indexes = sampler->data + VQ_CODEBOOK_SIZE;
+        if(mipmapped) {
+            indexes += VQMipmapBaseOffset(sampler->width);
+        }
+
+        sampler->decoded = DecodeCached(sampler, mode3, indexes);
+    } else if(paletted) {
+        if(mipmapped) {
+            sampler->data += PalettedMipmapBaseOffset(sampler->width);
+        }
+
+        sampler->decoded = DecodeCached(sampler, mode3, NULL);
+    } else if(mipmapped) {
+        sampler->data += MipmapBaseOffset(sampler->width);
+    }
+}
+
+static inline uint32_t WrapCoordinate(int32_t c, uint32_t size, bool clamp, bool flip) {
+    if(clamp) {
+        return (c < 0) ? 0 : ((uint32_t) c >= size) ? size - 1 : (uint32_t) c;
+    } else if(flip) {
+        uint32_t m = (uint32_t) c & ((size * 2) - 1);
+        return (m >= size) ? (size * 2) - 1 - m : m;
+    } else {
+        return (uint32_t) c & (size - 1);
+    }
+}
+
+static inline uint32_t TexelOffset(const Sampler* s, uint32_t x, uint32_t y) {
+    if(!s->twiddled) {
+        return y * s->width + x;
+    }
+
+    return TwiddledOffset(x, y, s->twiddle_mask, s->twiddle_shift);
+}
+
+static inline uint32_t DecodeTexel(uint32_t format, uint16_t p) {
+    uint32_t a, r, g, b;
+
+    switch(format) {
+        case FORMAT_ARGB1555:
+            a = (p & 0x8000) ? 255 : 0;
+            r = (p >> 10) & 0x1F;
+            g = (p >> 5) & 0x1F;
+            b = p & 0x1F;
+            r = (r << 3) | (r >> 2);
+            g = (g << 3) | (g >> 2);
+            b = (b << 3) | (b >> 2);
+        break;
+        case FORMAT_RGB565:
+            a = 255;
+            r = (p >> 11) & 0x1F;
+            g = (p >> 5) & 0x3F;
+            b = p & 0x1F;
+            r = (r << 3) | (r >> 2);
+            g = (g << 2) | (g >> 4);
+            b = (b << 3) | (b >> 2);
+        break;
+        case FORMAT_ARGB4444:
+            a = ((p >> 12) & 0xF) * 0x11;
+            r = ((p >> 8) & 0xF) * 0x11;
+            g = ((p >> 4) & 0xF) * 0x11;
+            b = (p & 0xF) * 0x11;
+        break;
+        default:
+            /* Unsupported formats sample as white */
+            return 0xFFFFFFFF;
+    }
+
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+static inline uint32_t FetchTexel(const Sampler* s, int32_t x, int32_t y) {
+    const uint32_t wx = WrapCoordinate(x, s->width, s->clamp_u, s->flip_u);
+    const uint32_t wy = WrapCoordinate(y, s->height, s->clamp_v, s->flip_v);
+
+    if(s->decoded) {
+        return s->decoded[wy * s->width + wx];
+    }
+
+    const uint16_t* texels = (const uint16_t*) s->data;
+    return DecodeTexel(s->format, texels[TexelOffset(s, wx, wy)]);
+}
+
+/* Weighted average of two ARGB8888 colours, w is 0 - 256 */
+static inline uint32_t LerpARGB(uint32_t c0, uint32_t c1, uint32_t w) {
+    const uint32_t rb0 = c0 & 0x00FF00FF, ag0 = (c0 >> 8) & 0x00FF00FF;
+    const uint32_t rb1 = c1 & 0x00FF00FF, ag1 = (c1 >> 8) & 0x00FF00FF;
+
+    const uint32_t rb = ((rb0 * (256 - w) + rb1 * w) >> 8) & 0x00FF00FF;
+    const uint32_t ag = ((ag0 * (256 - w) + ag1 * w) >> 8) & 0x00FF00FF;
+
+    return rb | (ag << 8);
+}
+
+uint32_t SamplerSample(const Sampler* sampler, float u, float v) {
+    const float fx = u * sampler->width;
+    const float fy = v * sampler->height;
+
+    if(!sampler->bilinear) {
+        return FetchTexel(sampler, (int32_t) floorf(fx), (int32_t) floorf(fy));
+    }
+
+    /* Sample between the four nearest texel centres, with 8 bits of
+     * fractional weight */
+    const int32_t sx = (int32_t) floorf((fx - 0.5f) * 256.0f);
+    const int32_t sy = (int32_t) floorf((fy - 0.5f) * 256.0f);
+
+    const int32_t x0 = sx >> 8, y0 = sy >> 8;
+    const uint32_t wx = sx & 0xFF, wy = sy & 0xFF;
+
+    const uint32_t t00 = FetchTexel(sampler, x0, y0);
+    const uint32_t t10 = FetchTexel(sampler, x0 + 1, y0);
+    const uint32_t t01 = FetchTexel(sampler, x0, y0 + 1);
+    const uint32_t t11 = FetchTexel(sampler, x0 + 1, y0 + 1);
+
+    return LerpARGB(LerpARGB(t00, t10, wx), LerpARGB(t01, t11, wx), wy);
+}
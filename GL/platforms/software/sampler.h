@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Decoded texture state from a polygon header, used to fetch
+ * ARGB8888 texels straight out of (twiddled) VRAM */
+typedef struct Sampler {
+    const uint8_t* data;
+
+    /* Paletted and VQ textures are sampled from a decoded ARGB8888
+     * copy (in linear order) held by the decode cache */
+    const uint32_t* decoded;
+
+    uint32_t format;
+    bool twiddled;
+
+    uint32_t width;
+    uint32_t height;
+
+    /* Twiddled textures are stored as a run of min(w, h) squares */
+    uint32_t twiddle_mask;
+    uint32_t twiddle_shift;
+
+    bool bilinear;
+    bool clamp_u;
+    bool clamp_v;
+    bool flip_u;
+    bool flip_v;
+} Sampler;
+
+/* Build the Morton lookup table, must be called before sampling */
+void SamplerInitTables();
+
+/* Called once per frame, before any headers are decoded. Decoded
+ * textures are revalidated against VRAM once per frame. */
+void SamplerBeginFrame();
+
+/* Palette RAM, 1024 entries interpreted according to the format */
+void SamplerSetPaletteFormat(uint32_t format);
+void SamplerSetPaletteEntry(uint32_t idx, uint32_t value);
+
+/* Decode mode2/mode3 of a textured header. vram is the base that
+ * texture addresses in mode3 are relative to. */
+void SamplerInit(Sampler* sampler, uint32_t mode2, uint32_t mode3, const uint8_t* vram);
+
+/* Sample at normalized texture coordinates, returns ARGB8888 */
+uint32_t SamplerSample(const Sampler* sampler, float u, float v);
@@ -96,6 +96,12 @@ typedef struct {
 typedef struct {
     unsigned int list_type;
     AlignedVector vector;
+
+    /* The offset of the last header pushed to the list, and of the end of
+     * the vertices sent under it. last_end is zero when there's no header
+     * to carry on from. */
+    uint32_t last_header;
+    uint32_t last_end;
 } PolyList;
 
 typedef struct {
@@ -253,6 +259,9 @@ typedef struct {
 
     /* Pointer to count * VertexExtra; */
     AlignedVector* extras;
+
+    /* Whether the normals in extras were normalized when read */
+    GLboolean normalized;
 } SubmissionTarget;
 
 Vertex* _glSubmissionTargetStart(SubmissionTarget* target);
@@ -289,10 +298,15 @@ void _glInitMatrices();
 void _glInitFramebuffers();
 
 void _glMatrixLoadNormal();
+
+/* False when the modelview scales non-uniformly, and unit normals
+ * come out of the normal matrix with other lengths */
+GLboolean _glNormalMatrixKeepsLength();
 void _glMatrixLoadModelView();
 void _glMatrixLoadProjection();
 void _glMatrixLoadTexture();
 void _glMatrixLoadModelViewProjection();
+void _glMatrixLoadIdentity();
 
 extern GLfloat DEPTH_RANGE_MULTIPLIER_L;
 extern GLfloat DEPTH_RANGE_MULTIPLIER_H;
@@ -300,6 +314,12 @@ extern GLfloat DEPTH_RANGE_MULTIPLIER_H;
 Matrix4x4* _glGetProjectionMatrix();
 Matrix4x4* _glGetModelViewMatrix();
 
+/* Cached, only recalculated once either matrix it's built from changes */
+const Matrix4x4* _glGetModelViewProjectionMatrix();
+
+/* Changes every time the top of the given stack changes */
+GLuint _glMatrixVersion(GLenum mode);
+
 void _glWipeTextureOnFramebuffers(GLuint texture);
 GLubyte _glCheckImmediateModeInactive(const char* func);
 
@@ -314,8 +334,160 @@ typedef struct {
     GLenum type;
     GLsizei stride;
     GLint size;
+
+    /* When set, the pointer was specified as an offset into this buffer
+     * object and ptr is recalculated from it at draw time */
+    GLuint buffer;
+    const void* offset;
 } AttribPointer;
 
+/* Everything that affects how arrays are converted to Vertex/VertexExtra */
+typedef struct {
+    GLuint enabled;
+    GLboolean normalize;
+    AttribPointer attribs[5];
+} VertexLayout;
+
+/* Triangles joined into strips by the stripifier. The indices are in
+ * strip order and ends holds the position of the last vertex of each
+ * strip. */
+typedef struct {
+    GLuint count;
+    GLuint* indices;
+    GLuint strip_count;
+    GLuint* ends;
+} StripList;
+
+GLboolean _glStripify(const GLuint* triangles, GLuint count, StripList* out);
+void _glFreeStripList(StripList* strips);
+
+/* Writes the index of the first vertex identical to each vertex */
+GLboolean _glWeldVertices(const Vertex* vertices, const VertexExtra* extras, GLuint count, GLuint* indices);
+
+typedef struct {
+    GLuint index;
+    GLenum usage;
+    GLsizeiptrARB size;
+    GLubyte* data;
+
+    /* Incremented whenever the data changes */
+    GLuint version;
+
+    /* Static buffers are converted to the internal vertex format once,
+     * for the layout and version they were last drawn with */
+    GLboolean converted;
+    GLuint converted_version;
+    GLuint converted_count;
+    GLuint converted_serial;
+    VertexLayout converted_layout;
+    AlignedVector vertices;
+    AlignedVector extras;
+
+    /* The last range of triangles drawn from this buffer with
+     * GL_STRIPIFY_KOS enabled. Indexed draws are keyed on the element
+     * data version, others on the converted vertices. */
+    GLboolean strips_valid;
+    GLuint strips_version;
+    GLenum strips_type;
+    GLsizeiptrARB strips_first;
+    GLuint strips_count;
+    StripList strips;
+
+    /* The largest index in the last range of elements drawn from this
+     * buffer, for the data version it was found in */
+    GLboolean max_index_valid;
+    GLuint max_index_version;
+    GLenum max_index_type;
+    GLsizeiptrARB max_index_first;
+    GLuint max_index_count;
+    GLuint max_index;
+} BufferObject;
+
+void _glInitBuffers();
+BufferObject* _glGetBufferObject(GLuint buffer);
+GLuint _glGetBoundArrayBuffer();
+GLuint _glGetBoundElementBuffer();
+void _glUnbindBufferFromAttribs(GLuint buffer);
+
+/* Post-transform vertex cache counters */
+typedef struct {
+    GLuint hits;
+    GLuint misses;
+} VertexCacheStats;
+
+/* Returns the counters of the last completed frame */
+const VertexCacheStats* _glGetVertexCacheStats();
+void _glVertexCacheFrameEnd();
+
+/* Compiled poly headers are cached until state they're built from
+ * changes, setters mark the headers they affect as dirty. Unit 0's bits
+ * cover the OP, PT and TR list headers, unit 1's the multitexture one. */
+#define HEADER_DIRTY_TEXTURE0   0x7
+#define HEADER_DIRTY_TEXTURE1   0x8
+#define HEADER_DIRTY_ALL        0xF
+#define HEADER_DIRTY_TEXTURE(unit) ((unit) ? HEADER_DIRTY_TEXTURE1 : HEADER_DIRTY_TEXTURE0)
+
+void _glMarkPolyHeadersDirty(GLuint mask);
+
+/* Marks the headers of any texture unit obj is bound to as dirty */
+void _glTextureObjectChanged(const TextureObject* obj);
+
+/* Headers left out of the last completed frame because a draw carried on
+ * under the same header as the draw before it */
+GLuint _glGetElidedHeaderCount();
+void _glElidedHeadersFrameEnd();
+
+/* A draw call recorded into a display list. The generated vertices are
+ * kept in object space, along with the clip space output of the last
+ * call which is replayed while the matrices are unchanged.
+ *
+ * Anything which depends on the shade model is left until the list is
+ * called: fans and polygons are recorded without the flat shading
+ * fix-up, and stripified triangles unstripped, with the strips built
+ * on the first smooth shaded call. */
+typedef struct {
+    GLuint attributes;
+    GLuint count;
+    Vertex* vertices;
+    VertexExtra* extras;
+
+    GLenum mode;
+    GLboolean stripify;
+    GLuint strip_count;
+    Vertex* strip_vertices;
+    VertexExtra* strip_extras;
+
+    GLboolean output_valid;
+    GLboolean output_flat;
+    GLboolean output_clipped;
+    GPUCulling output_cull;
+    Matrix4x4 output_modelview;
+    Matrix4x4 output_projection;
+    GLuint output_modelview_version;
+    GLuint output_projection_version;
+    GLuint output_count;
+    GLuint output_capacity;
+    Vertex* output;
+    VertexExtra* output_extras;
+} DisplayListChunk;
+
+typedef struct {
+    GLuint chunk_count;
+    DisplayListChunk* chunks;
+} DisplayList;
+
+void _glInitDisplayLists();
+
+/* GL_COMPILE or GL_COMPILE_AND_EXECUTE while a list is being compiled,
+ * otherwise zero */
+GLenum _glGetListMode();
+GLuint _glGetListIndex();
+GLuint _glGetListBase();
+
+void _glRecordListChunk(const Vertex* vertices, const VertexExtra* extras, GLuint count, GLuint attributes,
+    GLenum mode, GLboolean stripify);
+void _glSubmitDisplayListChunk(DisplayListChunk* chunk);
+
 GLboolean _glCheckValidEnum(GLint param, GLint* values, const char* func);
 
 GLuint* _glGetEnabledAttributes();
@@ -372,6 +544,17 @@ void _glEnableLight(GLubyte light, unsigned char value);
 GLboolean _glIsColorMaterialEnabled();
 
 GLboolean _glIsNormalizeEnabled();
+GLboolean _glIsStripifyEnabled();
+GPUCulling _glGetCpuCullMode();
+
+/* The state every draw needs, kept up to date by the setters so
+ * submitting doesn't have to query it through the public API */
+typedef struct {
+    GLboolean multitexture; /* GL_TEXTURE_2D is enabled on unit 1 */
+    GLboolean lighting;
+} DrawState;
+
+const DrawState* _glGetDrawState();
 
 GLboolean _glRecalcFastPath();
 
@@ -29,6 +29,16 @@ static GLboolean POLYGON_OFFSET_ENABLED = GL_FALSE;
 
 static GLboolean NORMALIZE_ENABLED = GL_FALSE;
 
+static GLboolean STRIPIFY_ENABLED = GL_FALSE;
+
+static GLboolean CPU_CULLING_ENABLED = GL_FALSE;
+
+static DrawState DRAW_STATE = {GL_FALSE, GL_FALSE};
+
+const DrawState* _glGetDrawState() {
+    return &DRAW_STATE;
+}
+
 static struct {
     GLint x;
     GLint y;
@@ -57,6 +67,12 @@ static int _calc_pvr_face_culling() {
     }
 }
 
+/* The winding culled before lighting and clipping, the same one the
+ * hardware would cull */
+GPUCulling _glGetCpuCullMode() {
+    return (CPU_CULLING_ENABLED) ? _calc_pvr_face_culling() : GPU_CULLING_NONE;
+}
+
 static GLenum DEPTH_FUNC = GL_LESS;
 static GLboolean DEPTH_TEST_ENABLED = GL_FALSE;
 
@@ -98,6 +114,10 @@ GLboolean _glIsNormalizeEnabled() {
     return NORMALIZE_ENABLED;
 }
 
+GLboolean _glIsStripifyEnabled() {
+    return STRIPIFY_ENABLED;
+}
+
 static int _calcPVRBlendFactor(GLenum factor) {
     switch(factor) {
     case GL_ZERO:
@@ -298,39 +318,49 @@ GLAPI void APIENTRY glEnable(GLenum cap) {
     switch(cap) {
         case GL_TEXTURE_2D:
             TEXTURES_ENABLED[_glGetActiveTexture()] = GL_TRUE;
+            DRAW_STATE.multitexture = TEXTURES_ENABLED[1];
+            _glMarkPolyHeadersDirty(HEADER_DIRTY_TEXTURE(_glGetActiveTexture()));
         break;
         case GL_CULL_FACE: {
             CULLING_ENABLED = GL_TRUE;
             GL_CONTEXT.gen.culling = _calc_pvr_face_culling();
+            _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
         } break;
         case GL_DEPTH_TEST: {
             DEPTH_TEST_ENABLED = GL_TRUE;
             GL_CONTEXT.depth.comparison = _calc_pvr_depth_test();
+            _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
         } break;
         case GL_BLEND: {
             BLEND_ENABLED = GL_TRUE;
             _updatePVRBlend(&GL_CONTEXT);
+            _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
         } break;
         case GL_SCISSOR_TEST: {
             GL_CONTEXT.gen.clip_mode = GPU_USERCLIP_INSIDE;
+            _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
             _glApplyScissor(false);
         } break;
         case GL_LIGHTING: {
             LIGHTING_ENABLED = GL_TRUE;
+            DRAW_STATE.lighting = GL_TRUE;
         } break;
         case GL_FOG:
             GL_CONTEXT.gen.fog_type = GPU_FOG_TABLE;
+            _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
         break;
         case GL_COLOR_MATERIAL:
             COLOR_MATERIAL_ENABLED = GL_TRUE;
         break;
         case GL_SHARED_TEXTURE_PALETTE_EXT: {
             SHARED_PALETTE_ENABLED = GL_TRUE;
+            _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
         }
         break;
         case GL_ALPHA_TEST: {
             ALPHA_TEST_ENABLED = GL_TRUE;
             _updatePVRBlend(&GL_CONTEXT);
+            _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
         } break;
         case GL_LIGHT0:
         case GL_LIGHT1:
@@ -353,6 +383,12 @@ GLAPI void APIENTRY glEnable(GLenum cap) {
         case GL_NORMALIZE:
             NORMALIZE_ENABLED = GL_TRUE;
         break;
+        case GL_STRIPIFY_KOS:
+            STRIPIFY_ENABLED = GL_TRUE;
+        break;
+        case GL_CPU_CULLING_KOS:
+            CPU_CULLING_ENABLED = GL_TRUE;
+        break;
     default:
         break;
     }
@@ -362,37 +398,47 @@ GLAPI void APIENTRY glDisable(GLenum cap) {
     switch(cap) {
         case GL_TEXTURE_2D: {
             TEXTURES_ENABLED[_glGetActiveTexture()] = GL_FALSE;
+            DRAW_STATE.multitexture = TEXTURES_ENABLED[1];
+            _glMarkPolyHeadersDirty(HEADER_DIRTY_TEXTURE(_glGetActiveTexture()));
         } break;
         case GL_CULL_FACE: {
             CULLING_ENABLED = GL_FALSE;
             GL_CONTEXT.gen.culling = _calc_pvr_face_culling();
+            _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
         } break;
         case GL_DEPTH_TEST: {
             DEPTH_TEST_ENABLED = GL_FALSE;
             GL_CONTEXT.depth.comparison = _calc_pvr_depth_test();
+            _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
         } break;
         case GL_BLEND:
             BLEND_ENABLED = GL_FALSE;
             _updatePVRBlend(&GL_CONTEXT);
+            _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
         break;
         case GL_SCISSOR_TEST: {
             GL_CONTEXT.gen.clip_mode = GPU_USERCLIP_DISABLE;
+            _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
         } break;
         case GL_LIGHTING: {
             LIGHTING_ENABLED = GL_FALSE;
+            DRAW_STATE.lighting = GL_FALSE;
         } break;
         case GL_FOG:
             GL_CONTEXT.gen.fog_type = GPU_FOG_DISABLE;
+            _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
         break;
         case GL_COLOR_MATERIAL:
             COLOR_MATERIAL_ENABLED = GL_FALSE;
         break;
         case GL_SHARED_TEXTURE_PALETTE_EXT: {
             SHARED_PALETTE_ENABLED = GL_FALSE;
+            _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
         }
         break;
         case GL_ALPHA_TEST: {
             ALPHA_TEST_ENABLED = GL_FALSE;
+            _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
         } break;
         case GL_LIGHT0:
         case GL_LIGHT1:
@@ -415,6 +461,12 @@ GLAPI void APIENTRY glDisable(GLenum cap) {
         case GL_NORMALIZE:
             NORMALIZE_ENABLED = GL_FALSE;
         break;
+        case GL_STRIPIFY_KOS:
+            STRIPIFY_ENABLED = GL_FALSE;
+        break;
+        case GL_CPU_CULLING_KOS:
+            CPU_CULLING_ENABLED = GL_FALSE;
+        break;
     default:
         break;
     }
@@ -463,11 +515,13 @@ GLAPI void APIENTRY glReadBuffer(GLenum mode) {
 
 GLAPI void APIENTRY glDepthMask(GLboolean flag) {
     GL_CONTEXT.depth.write = (flag == GL_TRUE) ? GPU_DEPTHWRITE_ENABLE : GPU_DEPTHWRITE_DISABLE;
+    _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
 }
 
 GLAPI void APIENTRY glDepthFunc(GLenum func) {
     DEPTH_FUNC = func;
     GL_CONTEXT.depth.comparison = _calc_pvr_depth_test();
+    _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
 }
 
 /* Hints */
@@ -483,11 +537,13 @@ GLAPI void APIENTRY glHint(GLenum target, GLenum mode) {
 GLAPI void APIENTRY glFrontFace(GLenum mode) {
     FRONT_FACE = mode;
     GL_CONTEXT.gen.culling = _calc_pvr_face_culling();
+    _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
 }
 
 GLAPI void APIENTRY glCullFace(GLenum mode) {
     CULL_FACE = mode;
     GL_CONTEXT.gen.culling = _calc_pvr_face_culling();
+    _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
 }
 
 GLenum _glGetShadeModel() {
@@ -497,6 +553,7 @@ GLenum _glGetShadeModel() {
 /* Shading - Flat or Goraud */
 GLAPI void APIENTRY glShadeModel(GLenum mode) {
     GL_CONTEXT.gen.shading = (mode == GL_SMOOTH) ? GPU_SHADE_GOURAUD : GPU_SHADE_FLAT;
+    _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
 }
 
 /* Blending */
@@ -504,6 +561,7 @@ GLAPI void APIENTRY glBlendFunc(GLenum sfactor, GLenum dfactor) {
     BLEND_SFACTOR = sfactor;
     BLEND_DFACTOR = dfactor;
     _updatePVRBlend(&GL_CONTEXT);
+    _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
 }
 
 
@@ -645,6 +703,10 @@ GLboolean APIENTRY glIsEnabled(GLenum cap) {
     case GL_POLYGON_OFFSET_LINE:
     case GL_POLYGON_OFFSET_FILL:
         return POLYGON_OFFSET_ENABLED;
+    case GL_STRIPIFY_KOS:
+        return STRIPIFY_ENABLED;
+    case GL_CPU_CULLING_KOS:
+        return CPU_CULLING_ENABLED;
     }
 
     return GL_FALSE;
@@ -738,6 +800,12 @@ void APIENTRY glGetIntegerv(GLenum pname, GLint *params) {
         case GL_ACTIVE_TEXTURE:
             *params = GL_TEXTURE0 + _glGetActiveTexture();
         break;
+        case GL_ARRAY_BUFFER_BINDING_ARB:
+            *params = _glGetBoundArrayBuffer();
+        break;
+        case GL_ELEMENT_ARRAY_BUFFER_BINDING_ARB:
+            *params = _glGetBoundElementBuffer();
+        break;
         case GL_CLIENT_ACTIVE_TEXTURE:
             *params = GL_TEXTURE0 + _glGetActiveClientTexture();
         break;
@@ -757,6 +825,44 @@ void APIENTRY glGetIntegerv(GLenum pname, GLint *params) {
         case GL_FREE_CONTIGUOUS_TEXTURE_MEMORY_KOS:
             *params = _glFreeContiguousTextureMemory();
         break;
+        case GL_HIZ_TRIANGLES_TESTED_KOS: {
+            GPUStats stats;
+            GPUGetStats(&stats);
+            *params = stats.hiz_triangles_tested;
+        } break;
+        case GL_HIZ_TRIANGLES_REJECTED_KOS: {
+            GPUStats stats;
+            GPUGetStats(&stats);
+            *params = stats.hiz_triangles_rejected;
+        } break;
+        case GL_HIZ_BLOCKS_TESTED_KOS: {
+            GPUStats stats;
+            GPUGetStats(&stats);
+            *params = stats.hiz_blocks_tested;
+        } break;
+        case GL_HIZ_BLOCKS_REJECTED_KOS: {
+            GPUStats stats;
+            GPUGetStats(&stats);
+            *params = stats.hiz_blocks_rejected;
+        } break;
+        case GL_LIST_MODE:
+            *params = _glGetListMode();
+        break;
+        case GL_LIST_INDEX:
+            *params = _glGetListIndex();
+        break;
+        case GL_LIST_BASE:
+            *params = _glGetListBase();
+        break;
+        case GL_VERTEX_CACHE_HITS_KOS:
+            *params = _glGetVertexCacheStats()->hits;
+        break;
+        case GL_VERTEX_CACHE_MISSES_KOS:
+            *params = _glGetVertexCacheStats()->misses;
+        break;
+        case GL_ELIDED_HEADERS_KOS:
+            *params = _glGetElidedHeaderCount();
+        break;
     default:
         _glKosThrowError(GL_INVALID_ENUM, __func__);
         _glKosPrintError();
@@ -776,7 +882,7 @@ const GLubyte *glGetString(GLenum name) {
             return (const GLubyte*) "1.2 (partial) - GLdc 1.1";
 
         case GL_EXTENSIONS:
-            return (const GLubyte*) "GL_ARB_framebuffer_object, GL_ARB_multitexture, GL_ARB_texture_rg, GL_EXT_paletted_texture, GL_EXT_shared_texture_palette, GL_KOS_multiple_shared_palette, GL_ARB_vertex_array_bgra, GL_ARB_vertex_type_2_10_10_10_rev, GL_KOS_texture_memory_management, GL_ATI_meminfo";
+            return (const GLubyte*) "GL_ARB_framebuffer_object, GL_ARB_multitexture, GL_ARB_texture_rg, GL_EXT_paletted_texture, GL_EXT_shared_texture_palette, GL_KOS_multiple_shared_palette, GL_ARB_vertex_array_bgra, GL_ARB_vertex_type_2_10_10_10_rev, GL_ARB_vertex_buffer_object, GL_KOS_texture_memory_management, GL_ATI_meminfo";
     }
 
     return (const GLubyte*) "GL_KOS_ERROR: ENUM Unsupported\n";
@@ -0,0 +1,282 @@
+/*
+ * Joins indexed triangle lists into strips (GL_STRIPIFY_KOS).
+ *
+ * Each triangle sent on its own costs three vertices, a strip costs one
+ * vertex per triangle plus two per strip. The strips are found greedily:
+ * starting from the first unused triangle, each step moves to the unused
+ * triangle sharing the edge that keeps the winding of the strip correct,
+ * so every triangle keeps its original orientation.
+ *
+ * current limitations:
+ *
+ * 1. The provoking vertex of a stripped triangle is whichever vertex
+ *    the strip reached it with, so callers don't strip when flat shading.
+ * 2. Strips are only ever extended forwards from their first triangle.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "private.h"
+
+typedef struct {
+    GLuint from;
+    GLuint to;
+    GLuint triangle;
+} StripEdge;
+
+#define EMPTY_SLOT 0xFFFFFFFF
+
+typedef struct {
+    const GLuint* triangles;
+    GLuint count;
+
+    StripEdge* edges;
+    GLuint mask;
+
+    /* Triangles already added to a strip */
+    GLubyte* used;
+
+    /* The walk which last visited each triangle, so a trial walk
+     * doesn't pass through the same triangle twice */
+    GLuint* visited;
+    GLuint walk;
+} Stripifier;
+
+GL_FORCE_INLINE GLuint edgeHash(GLuint from, GLuint to) {
+    return (from * 0x9E3779B1u) ^ (to * 0x85EBCA77u);
+}
+
+GL_FORCE_INLINE GLboolean isDegenerate(const GLuint* tri) {
+    return tri[0] == tri[1] || tri[1] == tri[2] || tri[2] == tri[0];
+}
+
+static void insertEdge(Stripifier* s, GLuint from, GLuint to, GLuint triangle) {
+    GLuint i = edgeHash(from, to) & s->mask;
+    while(s->edges[i].triangle != EMPTY_SLOT) {
+        i = (i + 1) & s->mask;
+    }
+
+    s->edges[i].from = from;
+    s->edges[i].to = to;
+    s->edges[i].triangle = triangle;
+}
+
+/* Returns a triangle with the directed edge from -> to which can still
+ * be added to the current walk */
+static GLuint findEdge(const Stripifier* s, GLuint from, GLuint to) {
+    GLuint i = edgeHash(from, to) & s->mask;
+    while(s->edges[i].triangle != EMPTY_SLOT) {
+        const StripEdge* e = &s->edges[i];
+        if(e->from == from && e->to == to && !s->used[e->triangle] && s->visited[e->triangle] != s->walk) {
+            return e->triangle;
+        }
+
+        i = (i + 1) & s->mask;
+    }
+
+    return EMPTY_SLOT;
+}
+
+/* The vertex following 'to' in a triangle containing the edge from -> to */
+GL_FORCE_INLINE GLuint thirdVertex(const GLuint* tri, GLuint to) {
+    return (tri[0] == to) ? tri[1] : (tri[1] == to) ? tri[2] : tri[0];
+}
+
+/* Walks a strip starting with the given rotation of a triangle, returning
+ * the number of triangles in it. If output is set the triangles are used
+ * up and the strip is appended to it. */
+static GLuint walkStrip(Stripifier* s, GLuint start, GLuint rotation, GLuint* output) {
+    const GLuint* tri = s->triangles + (start * 3);
+
+    GLuint p = tri[(rotation + 1) % 3];
+    GLuint q = tri[(rotation + 2) % 3];
+
+    s->walk++;
+    s->visited[start] = s->walk;
+
+    if(output) {
+        s->used[start] = 1;
+        *output++ = tri[rotation];
+        *output++ = p;
+        *output++ = q;
+    }
+
+    GLuint length = 1;
+
+    for(;;) {
+        /* Odd triangles in a strip are wound the other way, so the shared
+         * edge alternates direction */
+        const GLuint from = (length & 1) ? q : p;
+        const GLuint to = (length & 1) ? p : q;
+
+        const GLuint next = findEdge(s, from, to);
+        if(next == EMPTY_SLOT) {
+            break;
+        }
+
+        const GLuint v = thirdVertex(s->triangles + (next * 3), to);
+
+        s->visited[next] = s->walk;
+        if(output) {
+            s->used[next] = 1;
+            *output++ = v;
+        }
+
+        p = q;
+        q = v;
+        ++length;
+    }
+
+    return length;
+}
+
+void _glFreeStripList(StripList* strips) {
+    free(strips->indices);
+    free(strips->ends);
+    memset(strips, 0, sizeof(StripList));
+}
+
+GLboolean _glStripify(const GLuint* triangles, GLuint count, StripList* out) {
+    memset(out, 0, sizeof(StripList));
+
+    const GLuint triangleCount = count / 3;
+
+    GLuint edgeCount = 64;
+    while(edgeCount < triangleCount * 6) {
+        edgeCount <<= 1;
+    }
+
+    Stripifier s;
+    s.triangles = triangles;
+    s.count = triangleCount;
+    s.mask = edgeCount - 1;
+    s.walk = 0;
+    s.edges = (StripEdge*) malloc(sizeof(StripEdge) * edgeCount);
+    s.used = (GLubyte*) calloc(triangleCount + 1, sizeof(GLubyte));
+    s.visited = (GLuint*) calloc(triangleCount + 1, sizeof(GLuint));
+
+    /* No strip is longer than its triangles plus two */
+    out->indices = (GLuint*) malloc(sizeof(GLuint) * (triangleCount * 3 + 1));
+    out->ends = (GLuint*) malloc(sizeof(GLuint) * (triangleCount + 1));
+
+    if(!s.edges || !s.used || !s.visited || !out->indices || !out->ends) {
+        free(s.edges);
+        free(s.used);
+        free(s.visited);
+        _glFreeStripList(out);
+        return GL_FALSE;
+    }
+
+    memset(s.edges, 0xFF, sizeof(StripEdge) * edgeCount);
+
+    GLuint i;
+    for(i = 0; i < triangleCount; ++i) {
+        const GLuint* tri = triangles + (i * 3);
+
+        /* Degenerate triangles draw nothing, so are dropped */
+        if(isDegenerate(tri)) {
+            s.used[i] = 1;
+            continue;
+        }
+
+        insertEdge(&s, tri[0], tri[1], i);
+        insertEdge(&s, tri[1], tri[2], i);
+        insertEdge(&s, tri[2], tri[0], i);
+    }
+
+    for(i = 0; i < triangleCount; ++i) {
+        if(s.used[i]) {
+            continue;
+        }
+
+        /* Start from whichever edge of the triangle gives the longest strip */
+        GLuint best = 0, bestLength = 0, rotation;
+        for(rotation = 0; rotation < 3; ++rotation) {
+            const GLuint length = walkStrip(&s, i, rotation, NULL);
+            if(length > bestLength) {
+                best = rotation;
+                bestLength = length;
+            }
+        }
+
+        walkStrip(&s, i, best, out->indices + out->count);
+
+        out->count += bestLength + 2;
+        out->ends[out->strip_count++] = out->count - 1;
+    }
+
+    free(s.edges);
+    free(s.used);
+    free(s.visited);
+
+    return GL_TRUE;
+}
+
+/* Vertices are welded before they're transformed, when W is always one
+ * and the flags don't matter, so only the attributes are compared */
+#define WELD_OFFSET offsetof(Vertex, xyz)
+#define WELD_SIZE (offsetof(Vertex, w) - WELD_OFFSET)
+
+GL_FORCE_INLINE GLuint vertexHash(const Vertex* v, const VertexExtra* ve) {
+    const GLubyte* bytes = ((const GLubyte*) v) + WELD_OFFSET;
+    GLuint hash = 2166136261u;
+
+    GLuint i;
+    for(i = 0; i < WELD_SIZE; ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    bytes = (const GLubyte*) ve;
+    for(i = 0; i < sizeof(VertexExtra); ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+GL_FORCE_INLINE GLboolean vertexEqual(const Vertex* a, const VertexExtra* ae, const Vertex* b, const VertexExtra* be) {
+    return memcmp(((const GLubyte*) a) + WELD_OFFSET, ((const GLubyte*) b) + WELD_OFFSET, WELD_SIZE) == 0 &&
+        memcmp(ae, be, sizeof(VertexExtra)) == 0;
+}
+
+GLboolean _glWeldVertices(const Vertex* vertices, const VertexExtra* extras, GLuint count, GLuint* indices) {
+    GLuint size = 64;
+    while(size < count * 2) {
+        size <<= 1;
+    }
+
+    GLuint* table = (GLuint*) malloc(sizeof(GLuint) * size);
+    if(!table) {
+        return GL_FALSE;
+    }
+
+    memset(table, 0xFF, sizeof(GLuint) * size);
+
+    const GLuint mask = size - 1;
+
+    GLuint i;
+    for(i = 0; i < count; ++i) {
+        GLuint slot = vertexHash(vertices + i, extras + i) & mask;
+
+        for(;;) {
+            const GLuint j = table[slot];
+            if(j == EMPTY_SLOT) {
+                table[slot] = i;
+                indices[i] = i;
+                break;
+            }
+
+            if(vertexEqual(vertices + i, extras + i, vertices + j, extras + j)) {
+                indices[i] = j;
+                break;
+            }
+
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    free(table);
+    return GL_TRUE;
+}
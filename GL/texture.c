@@ -174,6 +174,8 @@ void _glSetInternalPaletteFormat(GLenum val) {
         assert(INTERNAL_PALETTE_FORMAT == GL_RGBA8);
         GPUSetPaletteFormat(GPU_PAL_ARGB8888);
     }
+
+    _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
 }
 
 void _glApplyColorTable(TexturePalette* src) {
@@ -403,6 +405,20 @@ TextureObject* _glGetBoundTexture() {
     return TEXTURE_UNITS[ACTIVE_TEXTURE];
 }
 
+void _glTextureObjectChanged(const TextureObject* obj) {
+    if(!obj) {
+        return;
+    }
+
+    if(obj == TEXTURE_UNITS[0]) {
+        _glMarkPolyHeadersDirty(HEADER_DIRTY_TEXTURE0);
+    }
+
+    if(obj == TEXTURE_UNITS[1]) {
+        _glMarkPolyHeadersDirty(HEADER_DIRTY_TEXTURE1);
+    }
+}
+
 void APIENTRY glActiveTextureARB(GLenum texture) {
     TRACE();
 
@@ -469,6 +485,8 @@ void APIENTRY glDeleteTextures(GLsizei n, GLuint *textures) {
         /* Make sure we update framebuffer objects that have this texture attached */
         _glWipeTextureOnFramebuffers(*textures);
 
+        _glTextureObjectChanged(txr);
+
         if(txr == TEXTURE_UNITS[ACTIVE_TEXTURE]) {
             TEXTURE_UNITS[ACTIVE_TEXTURE] = NULL;
         }
@@ -503,6 +521,8 @@ void APIENTRY glBindTexture(GLenum  target, GLuint texture) {
         return;
     }
 
+    TextureObject* previous = TEXTURE_UNITS[ACTIVE_TEXTURE];
+
     if(texture) {
         /* If this didn't come from glGenTextures, then we should initialize the
          * texture the first time it's bound */
@@ -515,6 +535,11 @@ void APIENTRY glBindTexture(GLenum  target, GLuint texture) {
     } else {
         TEXTURE_UNITS[ACTIVE_TEXTURE] = NULL;
     }
+
+    /* Rebinding the same texture doesn't change the headers */
+    if(TEXTURE_UNITS[ACTIVE_TEXTURE] != previous) {
+        _glMarkPolyHeadersDirty(HEADER_DIRTY_TEXTURE(ACTIVE_TEXTURE));
+    }
 }
 
 void APIENTRY glTexEnvi(GLenum target, GLenum pname, GLint param) {
@@ -534,6 +559,9 @@ void APIENTRY glTexEnvi(GLenum target, GLenum pname, GLint param) {
     if(failures) {
         return;
     }
+
+    _glTextureObjectChanged(active);
+
     switch(target){
         case GL_TEXTURE_ENV:
             {
@@ -592,6 +620,8 @@ void APIENTRY glCompressedTexImage2DARB(GLenum target,
                                      const GLvoid *data) {
     TRACE();
 
+    _glTextureObjectChanged(_glGetBoundTexture());
+
     if(target != GL_TEXTURE_2D) {
         _glKosThrowError(GL_INVALID_ENUM, __func__);
     }
@@ -1032,6 +1062,8 @@ void APIENTRY glTexImage2D(GLenum target, GLint level, GLint internalFormat,
 
     TRACE();
 
+    _glTextureObjectChanged(_glGetBoundTexture());
+
     if(target != GL_TEXTURE_2D) {
         INFO_MSG("");
         _glKosThrowError(GL_INVALID_ENUM, __func__);
@@ -1309,6 +1341,8 @@ void APIENTRY glTexParameteri(GLenum target, GLenum pname, GLint param) {
         return;
     }
 
+    _glTextureObjectChanged(active);
+
     if(target == GL_TEXTURE_2D) {
         switch(pname) {
             case GL_TEXTURE_MAG_FILTER:
@@ -1398,6 +1432,9 @@ GLAPI void APIENTRY glColorTableEXT(GLenum target, GLenum internalFormat, GLsize
         return;
     }
 
+    /* Palette banks can move, and shared palettes are used by any texture */
+    _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
+
     if(_glCheckValidEnum(internalFormat, validInternalFormats, __func__) != 0) {
         return;
     }
@@ -1634,4 +1671,6 @@ GLAPI GLvoid APIENTRY glDefragmentTextureMemory_KOS(void) {
     }
 
     yalloc_defrag_commit(YALLOC_BASE);
+
+    _glMarkPolyHeadersDirty(HEADER_DIRTY_ALL);
 }
@@ -271,6 +271,13 @@ __BEGIN_DECLS
 #define GL_FLAT         0x1d00
 #define GL_SMOOTH       0x1d01
 
+/* Display lists */
+#define GL_COMPILE                              0x1300
+#define GL_COMPILE_AND_EXECUTE                  0x1301
+#define GL_LIST_BASE                            0x0B32
+#define GL_LIST_INDEX                           0x0B33
+#define GL_LIST_MODE                            0x0B30
+
 /* Data types */
 #define GL_BYTE                                 0x1400
 #define GL_UNSIGNED_BYTE                        0x1401
@@ -464,6 +471,16 @@ GLAPI GLvoid APIENTRY glRecti(GLint x1, GLint y1, GLint x2, GLint y2);
 GLAPI GLvoid APIENTRY glRectiv(const GLint *v1, const GLint *v2);
 #define glRectsv glRectiv
 
+/* Display Lists */
+GLAPI GLuint APIENTRY glGenLists(GLsizei range);
+GLAPI void APIENTRY glDeleteLists(GLuint list, GLsizei range);
+GLAPI GLboolean APIENTRY glIsList(GLuint list);
+GLAPI void APIENTRY glNewList(GLuint list, GLenum mode);
+GLAPI void APIENTRY glEndList();
+GLAPI void APIENTRY glCallList(GLuint list);
+GLAPI void APIENTRY glCallLists(GLsizei n, GLenum type, const GLvoid *lists);
+GLAPI void APIENTRY glListBase(GLuint base);
+
 /* Enable / Disable Capability */
 /* Currently Supported Capabilities:
         GL_TEXTURE_2D
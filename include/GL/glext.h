@@ -9,6 +9,7 @@
 #define __GL_GLEXT_H
 
 #include <sys/cdefs.h>
+#include <stddef.h>
 __BEGIN_DECLS
 
 #define GL_TEXTURE0_ARB                   0x84C0
@@ -161,6 +162,37 @@ GLAPI void APIENTRY glGetColorTableEXT(GLenum target, GLenum format, GLenum type
 GLAPI void APIENTRY glGetColorTableParameterivEXT(GLenum target, GLenum pname, GLint *params);
 GLAPI void APIENTRY glGetColorTableParameterfvEXT(GLenum target, GLenum pname, GLfloat *params);
 
+/* ARB_vertex_buffer_object */
+typedef ptrdiff_t GLsizeiptrARB;
+typedef ptrdiff_t GLintptrARB;
+
+#define GL_BUFFER_SIZE_ARB                    0x8764
+#define GL_BUFFER_USAGE_ARB                   0x8765
+#define GL_ARRAY_BUFFER_ARB                   0x8892
+#define GL_ELEMENT_ARRAY_BUFFER_ARB           0x8893
+#define GL_ARRAY_BUFFER_BINDING_ARB           0x8894
+#define GL_ELEMENT_ARRAY_BUFFER_BINDING_ARB   0x8895
+#define GL_STREAM_DRAW_ARB                    0x88E0
+#define GL_STREAM_READ_ARB                    0x88E1
+#define GL_STREAM_COPY_ARB                    0x88E2
+#define GL_STATIC_DRAW_ARB                    0x88E4
+#define GL_STATIC_READ_ARB                    0x88E5
+#define GL_STATIC_COPY_ARB                    0x88E6
+#define GL_DYNAMIC_DRAW_ARB                   0x88E8
+#define GL_DYNAMIC_READ_ARB                   0x88E9
+#define GL_DYNAMIC_COPY_ARB                   0x88EA
+
+/* Buffers with GL_STATIC_DRAW usage which hold all the enabled arrays are
+ * converted to the internal vertex format the first time they are drawn,
+ * and then copied straight through on later draws */
+GLAPI void APIENTRY glGenBuffersARB(GLsizei n, GLuint* buffers);
+GLAPI void APIENTRY glDeleteBuffersARB(GLsizei n, const GLuint* buffers);
+GLAPI void APIENTRY glBindBufferARB(GLenum target, GLuint buffer);
+GLAPI void APIENTRY glBufferDataARB(GLenum target, GLsizeiptrARB size, const GLvoid* data, GLenum usage);
+GLAPI void APIENTRY glBufferSubDataARB(GLenum target, GLintptrARB offset, GLsizeiptrARB size, const GLvoid* data);
+GLAPI void APIENTRY glGetBufferParameterivARB(GLenum target, GLenum pname, GLint* params);
+GLAPI GLboolean APIENTRY glIsBufferARB(GLuint buffer);
+
 /* Loads VQ compressed texture from SH4 RAM into PVR VRAM */
 /* internalformat must be one of the following constants:
     GL_UNSIGNED_SHORT_5_6_5_VQ
@@ -190,6 +222,33 @@ GLAPI void APIENTRY glCompressedTexImage2DARB(GLenum target,
 #define glGenerateMipmap glGenerateMipmapEXT
 #define glCompressedTexImage2D glCompressedTexImage2DARB
 
+typedef GLsizeiptrARB GLsizeiptr;
+typedef GLintptrARB GLintptr;
+
+#define GL_BUFFER_SIZE GL_BUFFER_SIZE_ARB
+#define GL_BUFFER_USAGE GL_BUFFER_USAGE_ARB
+#define GL_ARRAY_BUFFER GL_ARRAY_BUFFER_ARB
+#define GL_ELEMENT_ARRAY_BUFFER GL_ELEMENT_ARRAY_BUFFER_ARB
+#define GL_ARRAY_BUFFER_BINDING GL_ARRAY_BUFFER_BINDING_ARB
+#define GL_ELEMENT_ARRAY_BUFFER_BINDING GL_ELEMENT_ARRAY_BUFFER_BINDING_ARB
+#define GL_STREAM_DRAW GL_STREAM_DRAW_ARB
+#define GL_STREAM_READ GL_STREAM_READ_ARB
+#define GL_STREAM_COPY GL_STREAM_COPY_ARB
+#define GL_STATIC_DRAW GL_STATIC_DRAW_ARB
+#define GL_STATIC_READ GL_STATIC_READ_ARB
+#define GL_STATIC_COPY GL_STATIC_COPY_ARB
+#define GL_DYNAMIC_DRAW GL_DYNAMIC_DRAW_ARB
+#define GL_DYNAMIC_READ GL_DYNAMIC_READ_ARB
+#define GL_DYNAMIC_COPY GL_DYNAMIC_COPY_ARB
+
+#define glGenBuffers glGenBuffersARB
+#define glDeleteBuffers glDeleteBuffersARB
+#define glBindBuffer glBindBufferARB
+#define glBufferData glBufferDataARB
+#define glBufferSubData glBufferSubDataARB
+#define glGetBufferParameteriv glGetBufferParameterivARB
+#define glIsBuffer glIsBufferARB
+
 #ifndef GL_VERSION_1_4
 #define GL_VERSION_1_4 1
 #define GL_MAX_TEXTURE_LOD_BIAS           0x84FD
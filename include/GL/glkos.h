@@ -48,6 +48,12 @@ typedef struct {
     /* If GL_TRUE, enables the PVR FSAA */
     GLboolean fsaa_enabled;
 
+    /* If GL_TRUE, the software backend renders into a memory framebuffer
+     * without creating a window (read it back with glKosGetFramebuffer).
+     * Defaults to GL_TRUE if the GLDC_HEADLESS environment variable is set.
+     * Ignored on the Dreamcast. */
+    GLboolean headless_enabled;
+
     /* The internal format for paletted textures, must be GL_RGBA4 (default) or GL_RGBA8 */
     GLenum internal_palette_format;
 
@@ -88,6 +94,11 @@ GLAPI void APIENTRY glKosInitConfig(GLdcConfig* config);
 GLAPI void APIENTRY glKosInitEx(GLdcConfig* config);
 GLAPI void APIENTRY glKosSwapBuffers();
 
+/* Returns the colour buffer of the last frame as ARGB8888 pixels, top row
+ * first, and writes its dimensions to width/height. Only available on the
+ * software backend, returns NULL on the Dreamcast. */
+GLAPI const GLuint* APIENTRY glKosGetFramebuffer(GLsizei* width, GLsizei* height);
+
 /*
  * CUSTOM EXTENSION multiple_shared_palette_KOS
  *
@@ -122,5 +133,43 @@ GLAPI GLvoid APIENTRY glDefragmentTextureMemory_KOS(void);
 #define GL_USED_TEXTURE_MEMORY_KOS                  0xEF02
 #define GL_FREE_CONTIGUOUS_TEXTURE_MEMORY_KOS       0xEF03
 
+/* Hierarchical Z counters for the last frame, pass to glGetIntegerv.
+ * Only the software renderer keeps these, they are zero on the PVR. */
+#define GL_HIZ_TRIANGLES_TESTED_KOS                 0xEF04
+#define GL_HIZ_TRIANGLES_REJECTED_KOS               0xEF05
+#define GL_HIZ_BLOCKS_TESTED_KOS                    0xEF06
+#define GL_HIZ_BLOCKS_REJECTED_KOS                  0xEF07
+
+/* Post-transform vertex cache counters for the last frame, pass to
+ * glGetIntegerv. Indexed draws count a hit for each index whose
+ * transformed vertex was reused within the same draw. */
+#define GL_VERTEX_CACHE_HITS_KOS                    0xEF08
+#define GL_VERTEX_CACHE_MISSES_KOS                  0xEF09
+
+/* Pass to glEnable to join GL_TRIANGLES draws into strips. The strips
+ * are worked out once and cached on the element buffer, or on the
+ * vertex buffer for static buffers drawn with glDrawArrays, or recorded
+ * into the display list being compiled. Other draws, and anything drawn
+ * while flat shading, are sent unchanged. */
+#define GL_STRIPIFY_KOS                             0xEF0A
+
+/* Pass to glEnable to drop the triangles GL_CULL_FACE would cull before
+ * they're lit, clipped and added to the poly lists, rather than leaving
+ * them all to the hardware */
+#define GL_CPU_CULLING_KOS                          0xEF0B
+
+/* The number of headers left out of the last frame, pass to glGetIntegerv.
+ * A draw which directly follows another in the same list, with identical
+ * polygon state, is sent under the earlier draw's header. */
+#define GL_ELIDED_HEADERS_KOS                       0xEF0C
+
+/* Bounds the next glDrawArrays, glDrawElements or glEnd in object space.
+ * The draw is skipped if the volume is outside the view frustum, and isn't
+ * clipped if the volume is entirely in front of the near plane, so the
+ * volume must contain every vertex of the draw. Ignored while compiling a
+ * display list. */
+GLAPI void APIENTRY glBoundingSphereKOS(GLfloat x, GLfloat y, GLfloat z, GLfloat radius);
+GLAPI void APIENTRY glBoundingBoxKOS(GLfloat minX, GLfloat minY, GLfloat minZ, GLfloat maxX, GLfloat maxY, GLfloat maxZ);
+
 __END_DECLS
 
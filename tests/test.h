@@ -0,0 +1,77 @@
+#pragma once
+
+/* Helpers shared by the regression tests. Each test renders into the
+ * software backend's headless framebuffer, reads pixels back and exits
+ * non-zero if any check failed. */
+
+#include <stdio.h>
+
+#include "GL/gl.h"
+#include "GL/glext.h"
+#include "GL/glkos.h"
+
+static int test_failures = 0;
+
+#define check(expr) \
+    do { \
+        if(!(expr)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+            ++test_failures; \
+        } \
+    } while(0)
+
+#define check_pixel(x, y, expected) \
+    do { \
+        const GLuint actual = test_pixel(x, y); \
+        if(actual != (expected)) { \
+            fprintf(stderr, "%s:%d: pixel (%d, %d) is %08x, expected %08x\n", \
+                __FILE__, __LINE__, (x), (y), actual, (GLuint) (expected)); \
+            ++test_failures; \
+        } \
+    } while(0)
+
+static inline void test_init(void) {
+    GLdcConfig config;
+    glKosInitConfig(&config);
+    config.headless_enabled = GL_TRUE;
+    glKosInitEx(&config);
+}
+
+/* Maps x and y straight to framebuffer pixels, top row first */
+static inline void test_pixel_projection(void) {
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(0, 640, 480, 0, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+}
+
+static inline GLuint test_pixel(int x, int y) {
+    GLsizei width, height;
+    const GLuint* pixels = glKosGetFramebuffer(&width, &height);
+    return pixels[y * width + x];
+}
+
+/* FNV-1a over the last frame, for comparing two renders */
+static inline GLuint test_hash_framebuffer(void) {
+    GLsizei width, height;
+    const GLuint* pixels = glKosGetFramebuffer(&width, &height);
+
+    GLuint hash = 2166136261u;
+    for(GLsizei i = 0; i < width * height; ++i) {
+        hash ^= pixels[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static inline int test_finish(const char* name) {
+    if(test_failures) {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, test_failures);
+        return 1;
+    }
+
+    printf("%s: passed\n", name);
+    return 0;
+}
@@ -0,0 +1,138 @@
+/* Static draw buffers are converted once and the copy reused by later
+ * draws. Respecifying or updating a buffer must drop that copy, and
+ * the strips and largest index cached for an index buffer. */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "test.h"
+
+typedef struct {
+    GLfloat x, y, z;
+    GLubyte rgba[4];
+} Vertex;
+
+#define RED 0xFFFF0000
+#define GREEN 0xFF00FF00
+#define BLUE 0xFF0000FF
+
+static void quad(Vertex* out, float x0, float y0, float x1, float y1, GLuint argb) {
+    const float xs[4] = {x0, x1, x0, x1};
+    const float ys[4] = {y0, y0, y1, y1};
+
+    for(int i = 0; i < 4; ++i) {
+        out[i].x = xs[i];
+        out[i].y = ys[i];
+        out[i].z = 0.0f;
+        out[i].rgba[0] = (argb >> 16) & 0xFF;
+        out[i].rgba[1] = (argb >> 8) & 0xFF;
+        out[i].rgba[2] = argb & 0xFF;
+        out[i].rgba[3] = argb >> 24;
+    }
+}
+
+static void bind_vertices(GLuint buffer) {
+    glBindBufferARB(GL_ARRAY_BUFFER_ARB, buffer);
+    glVertexPointer(3, GL_FLOAT, sizeof(Vertex), (const GLvoid*) offsetof(Vertex, x));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex), (const GLvoid*) offsetof(Vertex, rgba));
+}
+
+static void draw_arrays() {
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glKosSwapBuffers();
+}
+
+static void draw_elements() {
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+    glKosSwapBuffers();
+}
+
+int main(void) {
+    test_init();
+    test_pixel_projection();
+
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+
+    Vertex vertices[8];
+    GLuint buffers[2];
+    glGenBuffersARB(2, buffers);
+
+    /* glBufferSubData replaces part of the converted vertices */
+    quad(vertices, 100, 100, 300, 300, RED);
+    bind_vertices(buffers[0]);
+    glBufferDataARB(GL_ARRAY_BUFFER_ARB, sizeof(Vertex) * 4, vertices, GL_STATIC_DRAW_ARB);
+
+    draw_arrays();
+    draw_arrays();
+    check_pixel(200, 200, RED);
+
+    quad(vertices, 100, 100, 300, 300, GREEN);
+    glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, 0, sizeof(Vertex) * 4, vertices);
+
+    draw_arrays();
+    check_pixel(200, 200, GREEN);
+
+    /* glBufferData respecifies the whole buffer */
+    quad(vertices, 400, 100, 600, 300, BLUE);
+    glBufferDataARB(GL_ARRAY_BUFFER_ARB, sizeof(Vertex) * 4, vertices, GL_STATIC_DRAW_ARB);
+
+    draw_arrays();
+    check_pixel(200, 200, 0xFF000000);
+    check_pixel(500, 200, BLUE);
+
+    /* Indexed draws are stripified from the index buffer once and the
+     * strips reused, until either buffer changes */
+    glEnable(GL_STRIPIFY_KOS);
+
+    quad(vertices, 100, 100, 300, 300, RED);
+    quad(vertices + 4, 400, 100, 600, 300, GREEN);
+    glBufferDataARB(GL_ARRAY_BUFFER_ARB, sizeof(vertices), vertices, GL_STATIC_DRAW_ARB);
+
+    GLushort indices[6] = {0, 2, 1, 1, 2, 3};
+    glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, buffers[1]);
+    glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, sizeof(indices), indices, GL_STATIC_DRAW_ARB);
+
+    draw_elements();
+    draw_elements();
+    check_pixel(200, 200, RED);
+    check_pixel(500, 200, 0xFF000000);
+
+    for(int i = 0; i < 6; ++i) {
+        indices[i] += 4;
+    }
+
+    glBufferSubDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0, sizeof(indices), indices);
+
+    draw_elements();
+    check_pixel(200, 200, 0xFF000000);
+    check_pixel(500, 200, GREEN);
+
+    quad(vertices + 4, 400, 100, 600, 300, BLUE);
+    glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, sizeof(Vertex) * 4, sizeof(Vertex) * 4, vertices + 4);
+
+    draw_elements();
+    check_pixel(500, 200, BLUE);
+
+    /* Draws with an index past the converted vertices are rejected. The
+     * largest index is cached on the index buffer too. */
+    indices[5] = 8;
+    glBufferSubDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0, sizeof(indices), indices);
+
+    draw_elements();
+    check_pixel(500, 200, 0xFF000000);
+
+    indices[5] = 7;
+    glBufferSubDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0, sizeof(indices), indices);
+
+    draw_elements();
+    draw_elements();
+    check_pixel(500, 200, BLUE);
+
+    glDeleteBuffersARB(2, buffers);
+
+    return test_finish("test_buffer_cache");
+}
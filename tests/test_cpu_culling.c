@@ -0,0 +1,153 @@
+/* GL_CPU_CULLING_KOS must drop exactly the triangles the hardware would
+ * cull, for either front face and either cull face, whatever primitive
+ * they were submitted as. */
+
+#include <math.h>
+
+#include "GL/glu.h"
+
+#include "test.h"
+
+#define SLICES 24
+#define STACKS 16
+
+typedef struct {
+    GLfloat x, y, z;
+    GLubyte bgra[4];
+} Vertex;
+
+static Vertex sphere[(SLICES + 1) * (STACKS + 1)];
+static GLushort triangles[SLICES * STACKS * 6];
+static GLushort quads[SLICES * STACKS * 4];
+static GLushort strips[STACKS][(SLICES + 1) * 2];
+
+static void build() {
+    for(int j = 0; j <= STACKS; ++j) {
+        for(int i = 0; i <= SLICES; ++i) {
+            const float theta = j * M_PI / STACKS;
+            const float phi = i * 2.0f * M_PI / SLICES;
+
+            Vertex* v = &sphere[j * (SLICES + 1) + i];
+            v->x = sinf(theta) * cosf(phi);
+            v->y = cosf(theta);
+            v->z = sinf(theta) * sinf(phi);
+            v->bgra[0] = 200;
+            v->bgra[1] = j * 15;
+            v->bgra[2] = i * 10;
+            v->bgra[3] = 255;
+        }
+    }
+
+    int t = 0, q = 0;
+    for(int j = 0; j < STACKS; ++j) {
+        for(int i = 0; i < SLICES; ++i) {
+            const GLushort a = j * (SLICES + 1) + i, b = a + 1;
+            const GLushort c = a + SLICES + 1, d = c + 1;
+
+            triangles[t++] = a; triangles[t++] = b; triangles[t++] = c;
+            triangles[t++] = b; triangles[t++] = d; triangles[t++] = c;
+
+            quads[q++] = a; quads[q++] = b; quads[q++] = d; quads[q++] = c;
+        }
+
+        for(int i = 0; i <= SLICES; ++i) {
+            strips[j][i * 2 + 0] = j * (SLICES + 1) + i;
+            strips[j][i * 2 + 1] = (j + 1) * (SLICES + 1) + i;
+        }
+    }
+}
+
+static GLuint render(int primitive, GLboolean cpu) {
+    if(cpu) {
+        glEnable(GL_CPU_CULLING_KOS);
+    } else {
+        glDisable(GL_CPU_CULLING_KOS);
+    }
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    if(primitive == 0) {
+        glDrawElements(GL_TRIANGLES, SLICES * STACKS * 6, GL_UNSIGNED_SHORT, triangles);
+    } else if(primitive == 1) {
+        glDrawElements(GL_QUADS, SLICES * STACKS * 4, GL_UNSIGNED_SHORT, quads);
+    } else {
+        for(int j = 0; j < STACKS; ++j) {
+            glDrawElements(GL_TRIANGLE_STRIP, (SLICES + 1) * 2, GL_UNSIGNED_SHORT, strips[j]);
+        }
+    }
+
+    glKosSwapBuffers();
+    return test_hash_framebuffer();
+}
+
+int main(void) {
+    test_init();
+    build();
+
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluPerspective(60.0f, 640.0f / 480.0f, 0.1f, 100.0f);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glTranslatef(0.0f, 0.0f, -3.0f);
+    glRotatef(30.0f, 1.0f, 1.0f, 0.0f);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(Vertex), &sphere[0].x);
+    glColorPointer(GL_BGRA, GL_UNSIGNED_BYTE, sizeof(Vertex), sphere[0].bgra);
+
+    /* Culling either face leaves a different half of the sphere */
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+
+    const GLenum fronts[] = {GL_CCW, GL_CW};
+    const GLenum faces[] = {GL_BACK, GL_FRONT};
+
+    for(int p = 0; p < 3; ++p) {
+        GLuint hashes[2][2];
+
+        for(int f = 0; f < 2; ++f) {
+            for(int c = 0; c < 2; ++c) {
+                glFrontFace(fronts[f]);
+                glCullFace(faces[c]);
+
+                hashes[f][c] = render(p, GL_FALSE);
+                check(render(p, GL_TRUE) == hashes[f][c]);
+            }
+        }
+
+        /* The two faces cull different halves, and swapping the front
+         * face swaps which half each of them culls */
+        check(hashes[0][0] != hashes[0][1]);
+        check(hashes[0][0] == hashes[1][1]);
+        check(hashes[0][1] == hashes[1][0]);
+    }
+
+    /* Display lists are culled when they're called, not compiled */
+    glFrontFace(GL_CCW);
+    glCullFace(GL_BACK);
+
+    GLuint list = glGenLists(1);
+    glNewList(list, GL_COMPILE);
+    glDrawElements(GL_TRIANGLES, SLICES * STACKS * 6, GL_UNSIGNED_SHORT, triangles);
+    glEndList();
+
+    for(int f = 0; f < 2; ++f) {
+        glFrontFace(fronts[f]);
+
+        const GLuint expected = render(0, GL_FALSE);
+
+        glEnable(GL_CPU_CULLING_KOS);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glCallList(list);
+        glKosSwapBuffers();
+        check(test_hash_framebuffer() == expected);
+    }
+
+    glDeleteLists(list, 1);
+
+    return test_finish("test_cpu_culling");
+}
@@ -0,0 +1,158 @@
+/* Display lists store untransformed vertices, so a list replayed under a
+ * different matrix or shade model must draw the same as submitting its
+ * contents directly at that point. */
+
+#include <math.h>
+
+#include "test.h"
+
+#define FAN_VERTICES 9
+
+static GLfloat positions[FAN_VERTICES * 3];
+static GLubyte colors[FAN_VERTICES * 4];
+
+static void quad() {
+    glBegin(GL_QUADS);
+        glColor3f(1.0f, 0.0f, 0.0f);
+        glVertex3f(0, 0, 0);
+        glVertex3f(100, 0, 0);
+        glVertex3f(100, 100, 0);
+        glVertex3f(0, 100, 0);
+    glEnd();
+}
+
+static void fan() {
+    glDrawArrays(GL_TRIANGLE_FAN, 0, FAN_VERTICES);
+}
+
+static void polygon() {
+    glDrawArrays(GL_POLYGON, 0, FAN_VERTICES);
+}
+
+static GLuint compile(void (*draw)()) {
+    GLuint list = glGenLists(1);
+    glNewList(list, GL_COMPILE);
+    draw();
+    glEndList();
+    return list;
+}
+
+static GLuint render(void (*draw)(), GLuint list) {
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    if(list) {
+        glCallList(list);
+    } else {
+        draw();
+    }
+
+    glKosSwapBuffers();
+    return test_hash_framebuffer();
+}
+
+static void check_matrix_replay() {
+    test_pixel_projection();
+    glTranslatef(100, 100, 0);
+
+    GLuint list = compile(quad);
+
+    /* Nothing is drawn while compiling */
+    glKosSwapBuffers();
+    check_pixel(150, 150, 0xFF000000);
+
+    render(NULL, list);
+    check_pixel(150, 150, 0xFFFF0000);
+    check_pixel(350, 150, 0xFF000000);
+
+    glLoadIdentity();
+    glTranslatef(300, 100, 0);
+
+    render(NULL, list);
+    check_pixel(150, 150, 0xFF000000);
+    check_pixel(350, 150, 0xFFFF0000);
+
+    glScalef(2.0f, 2.0f, 1.0f);
+
+    render(NULL, list);
+    check_pixel(450, 250, 0xFFFF0000);
+
+    /* Lists called from lists pick up the matrix at the outer call */
+    GLuint outer = glGenLists(1);
+    glNewList(outer, GL_COMPILE);
+    glCallList(list);
+    glEndList();
+
+    glLoadIdentity();
+    glTranslatef(500, 300, 0);
+
+    render(NULL, outer);
+    check_pixel(550, 350, 0xFFFF0000);
+    check_pixel(350, 150, 0xFF000000);
+
+    glDeleteLists(list, 1);
+    glDeleteLists(outer, 1);
+}
+
+static void check_shade_replay() {
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    for(int i = 0; i < FAN_VERTICES; ++i) {
+        const float angle = i * 2.0f * M_PI / FAN_VERTICES;
+        positions[i * 3 + 0] = (i) ? 0.8f * cosf(angle) : 0.0f;
+        positions[i * 3 + 1] = (i) ? 0.8f * sinf(angle) : 0.0f;
+        positions[i * 3 + 2] = -0.5f;
+
+        colors[i * 4 + 0] = i * 29;
+        colors[i * 4 + 1] = 255 - i * 20;
+        colors[i * 4 + 2] = i * 50;
+        colors[i * 4 + 3] = 255;
+    }
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, positions);
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, colors);
+
+    /* Fans and polygons are stripified, and flat shading is fixed up on
+     * the strips, which must follow the shade model at the call */
+    glEnable(GL_STRIPIFY_KOS);
+
+    void (*draws[])() = {fan, polygon};
+    const GLenum models[] = {GL_SMOOTH, GL_FLAT};
+
+    for(int d = 0; d < 2; ++d) {
+        for(int compiled = 0; compiled < 2; ++compiled) {
+            glShadeModel(models[compiled]);
+            GLuint list = compile(draws[d]);
+
+            for(int called = 0; called < 2; ++called) {
+                glShadeModel(models[called]);
+
+                const GLuint expected = render(draws[d], 0);
+                check(render(NULL, list) == expected);
+                check(render(NULL, list) == expected);
+            }
+
+            glDeleteLists(list, 1);
+        }
+    }
+
+    glDisable(GL_STRIPIFY_KOS);
+    glShadeModel(GL_SMOOTH);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+}
+
+int main(void) {
+    test_init();
+
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    check_matrix_replay();
+    check_shade_replay();
+
+    return test_finish("test_display_lists");
+}
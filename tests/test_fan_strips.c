@@ -0,0 +1,124 @@
+/* Triangle fans and polygons are sent as strips. The strips must keep
+ * the winding and the triangulation of the original primitive, which
+ * back face culling makes visible. */
+
+#include <math.h>
+
+#include "test.h"
+
+#define MAX_VERTICES 300
+
+static GLfloat positions[MAX_VERTICES * 3];
+static GLubyte colors[MAX_VERTICES * 4];
+static GLushort triangles[(MAX_VERTICES - 2) * 3];
+
+/* A convex shape around the centre of the screen, counter-clockwise
+ * unless reversed. Fans start at the centre and stop short of closing
+ * the rim, polygons are all rim. */
+static void build(GLuint count, GLboolean centred, GLboolean reversed) {
+    const float step = ((reversed) ? -2.0f : 2.0f) * M_PI / count;
+
+    for(GLuint i = 0; i < count; ++i) {
+        const float angle = ((centred) ? i - 1.0f : i) * step;
+        const float radius = (centred && i == 0) ? 0.0f : 0.8f;
+
+        positions[i * 3 + 0] = radius * cosf(angle) * 0.75f;
+        positions[i * 3 + 1] = radius * sinf(angle);
+        positions[i * 3 + 2] = -0.5f;
+
+        colors[i * 4 + 0] = i * 37;
+        colors[i * 4 + 1] = 255 - i * 11;
+        colors[i * 4 + 2] = i * 73;
+        colors[i * 4 + 3] = 255;
+    }
+
+    if(centred) {
+        /* The triangulation of the fan */
+        for(GLuint i = 0; i + 2 < count; ++i) {
+            triangles[i * 3 + 0] = 0;
+            triangles[i * 3 + 1] = i + 1;
+            triangles[i * 3 + 2] = i + 2;
+        }
+    } else {
+        /* Polygons are sent as a zig-zag strip across the rim,
+         * (0, 1, N - 1, 2, N - 2...), so expect its triangles */
+        GLushort order[MAX_VERTICES];
+        GLuint left = 1, right = count - 1;
+
+        order[0] = 0;
+        for(GLuint i = 1; i < count; ++i) {
+            order[i] = (i & 1) ? left++ : right--;
+        }
+
+        for(GLuint i = 0; i + 2 < count; ++i) {
+            triangles[i * 3 + 0] = order[(i & 1) ? i + 1 : i];
+            triangles[i * 3 + 1] = order[(i & 1) ? i : i + 1];
+            triangles[i * 3 + 2] = order[i + 2];
+        }
+    }
+}
+
+static GLuint render_arrays(GLenum mode, GLuint count) {
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDrawArrays(mode, 0, count);
+    glKosSwapBuffers();
+    return test_hash_framebuffer();
+}
+
+static GLuint render_triangles(GLuint count) {
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDrawElements(GL_TRIANGLES, (count - 2) * 3, GL_UNSIGNED_SHORT, triangles);
+    glKosSwapBuffers();
+    return test_hash_framebuffer();
+}
+
+int main(void) {
+    test_init();
+
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, positions);
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, colors);
+
+    glEnable(GL_CULL_FACE);
+
+    glKosSwapBuffers();
+    const GLuint empty = test_hash_framebuffer();
+
+    const GLenum modes[] = {GL_TRIANGLE_FAN, GL_POLYGON};
+    const GLuint counts[] = {3, 4, 5, 9, MAX_VERTICES};
+    const GLenum faces[] = {GL_BACK, GL_FRONT};
+
+    for(int m = 0; m < 2; ++m) {
+        const GLboolean centred = modes[m] == GL_TRIANGLE_FAN;
+
+        for(int c = 0; c < 5; ++c) {
+            for(int r = 0; r < 2; ++r) {
+                build(counts[c], centred, r);
+
+                /* Every triangle faces the same way, so one of the faces
+                 * draws all of them and the other none */
+                GLuint drawn = 0;
+
+                for(int f = 0; f < 2; ++f) {
+                    glCullFace(faces[f]);
+
+                    const GLuint expected = render_triangles(counts[c]);
+                    check(render_arrays(modes[m], counts[c]) == expected);
+                    drawn += expected != empty;
+                }
+
+                check(drawn == 1);
+
+                /* Both windings draw the same with culling off */
+                glDisable(GL_CULL_FACE);
+                check(render_arrays(modes[m], counts[c]) == render_triangles(counts[c]));
+                glEnable(GL_CULL_FACE);
+            }
+        }
+    }
+
+    return test_finish("test_fan_strips");
+}
@@ -0,0 +1,169 @@
+/* Normals are transformed by the inverse transpose of the modelview
+ * matrix, so a lit unit sphere scaled by the modelview looks the same as
+ * an ellipsoid with the scale baked into its vertices and normals. */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "GL/glu.h"
+
+#include "test.h"
+
+#define SLICES 40
+#define STACKS 30
+
+typedef struct {
+    GLfloat x, y, z;
+    GLfloat nx, ny, nz;
+} Vertex;
+
+static Vertex unit[(SLICES + 1) * (STACKS + 1)];
+static Vertex scaled[(SLICES + 1) * (STACKS + 1)];
+static Vertex longer[(SLICES + 1) * (STACKS + 1)];
+static GLushort triangles[SLICES * STACKS * 6];
+
+static GLuint expected[640 * 480];
+
+static void build(const GLfloat* scale) {
+    for(int j = 0; j <= STACKS; ++j) {
+        for(int i = 0; i <= SLICES; ++i) {
+            const float theta = j * M_PI / STACKS;
+            const float phi = i * 2.0f * M_PI / SLICES;
+            const float n[3] = {sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi)};
+
+            Vertex* u = &unit[j * (SLICES + 1) + i];
+            Vertex* s = &scaled[j * (SLICES + 1) + i];
+
+            u->x = u->nx = n[0];
+            u->y = u->ny = n[1];
+            u->z = u->nz = n[2];
+
+            /* Scaling a surface divides its normals by the scale */
+            const float m[3] = {n[0] / scale[0], n[1] / scale[1], n[2] / scale[2]};
+            const float length = sqrtf(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+
+            s->x = n[0] * scale[0];
+            s->y = n[1] * scale[1];
+            s->z = n[2] * scale[2];
+            s->nx = m[0] / length;
+            s->ny = m[1] / length;
+            s->nz = m[2] / length;
+
+            /* GL_NORMALIZE also applies to normals submitted longer than unit */
+            Vertex* l = &longer[j * (SLICES + 1) + i];
+            *l = *u;
+            l->nx *= 3.0f;
+            l->ny *= 3.0f;
+            l->nz *= 3.0f;
+        }
+    }
+
+    int t = 0;
+    for(int j = 0; j < STACKS; ++j) {
+        for(int i = 0; i < SLICES; ++i) {
+            const GLushort a = j * (SLICES + 1) + i, b = a + 1;
+            const GLushort c = a + SLICES + 1, d = c + 1;
+
+            triangles[t++] = a; triangles[t++] = b; triangles[t++] = c;
+            triangles[t++] = b; triangles[t++] = d; triangles[t++] = c;
+        }
+    }
+}
+
+static void draw(const Vertex* vertices) {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glVertexPointer(3, GL_FLOAT, sizeof(Vertex), &vertices[0].x);
+    glNormalPointer(GL_FLOAT, sizeof(Vertex), &vertices[0].nx);
+    glDrawElements(GL_TRIANGLES, SLICES * STACKS * 6, GL_UNSIGNED_SHORT, triangles);
+    glKosSwapBuffers();
+}
+
+/* The largest difference in any channel of any pixel */
+static int max_difference(const GLuint* lhs, const GLuint* rhs, int count) {
+    int result = 0;
+
+    for(int i = 0; i < count; ++i) {
+        for(int shift = 0; shift < 32; shift += 8) {
+            const int d = abs((int) ((lhs[i] >> shift) & 0xFF) - (int) ((rhs[i] >> shift) & 0xFF));
+            result = (d > result) ? d : result;
+        }
+    }
+
+    return result;
+}
+
+int main(void) {
+    test_init();
+
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluPerspective(60.0f, 640.0f / 480.0f, 0.1f, 100.0f);
+    glMatrixMode(GL_MODELVIEW);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_LIGHTING);
+    glEnable(GL_LIGHT0);
+
+    /* The scaled normals aren't unit length, only their direction is
+     * defined by the normal matrix */
+    glEnable(GL_NORMALIZE);
+
+    const GLfloat light[] = {1.0f, 1.0f, 1.0f, 0.0f};
+    glLightfv(GL_LIGHT0, GL_POSITION, light);
+
+    const GLfloat scales[][3] = {
+        {2.0f, 2.0f, 2.0f},
+        {0.5f, 0.5f, 0.5f},
+        {2.0f, 1.0f, 0.5f},
+        {1.0f, 3.0f, 1.0f},
+    };
+
+    for(int s = 0; s < 4; ++s) {
+        build(scales[s]);
+
+        glLoadIdentity();
+        glTranslatef(0.0f, 0.0f, -6.0f);
+        glRotatef(30.0f, 1.0f, 1.0f, 0.0f);
+
+        draw(scaled);
+
+        GLsizei width, height;
+        const GLuint* pixels = glKosGetFramebuffer(&width, &height);
+        memcpy(expected, pixels, sizeof(GLuint) * width * height);
+
+        glScalef(scales[s][0], scales[s][1], scales[s][2]);
+        draw(unit);
+
+        /* Allow for rounding in the two paths */
+        check(max_difference(expected, glKosGetFramebuffer(NULL, NULL), width * height) <= 2);
+        check(test_pixel(320, 240) != 0xFF000000);
+
+        /* Indexed draws read the normals as they are, so they still need
+         * normalizing after a uniform scale */
+        if(scales[s][0] == scales[s][1] && scales[s][1] == scales[s][2]) {
+            memcpy(expected, glKosGetFramebuffer(NULL, NULL), sizeof(GLuint) * width * height);
+
+            draw(longer);
+            check(max_difference(expected, glKosGetFramebuffer(NULL, NULL), width * height) <= 2);
+        }
+    }
+
+    /* The same without any scale at all */
+    build(scales[0]);
+
+    glLoadIdentity();
+    glTranslatef(0.0f, 0.0f, -6.0f);
+    draw(unit);
+
+    memcpy(expected, glKosGetFramebuffer(NULL, NULL), sizeof(expected));
+
+    draw(longer);
+    check(max_difference(expected, glKosGetFramebuffer(NULL, NULL), 640 * 480) <= 2);
+
+    return test_finish("test_normal_matrix");
+}